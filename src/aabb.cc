@@ -0,0 +1,60 @@
+#include "aabb.hh"
+
+#include <algorithm>
+
+#include "utils.hh"
+
+AABB::AABB()
+    : min_(Point3(+utils::infinity, +utils::infinity, +utils::infinity))
+    , max_(Point3(-utils::infinity, -utils::infinity, -utils::infinity))
+{}
+
+AABB::AABB(const Point3 &min, const Point3 &max)
+    : min_(min)
+    , max_(max)
+{}
+
+bool AABB::hit(const Ray &ray, Interval &ray_t) const
+{
+    const double origin[3] = { ray.origin_.x_, ray.origin_.y_, ray.origin_.z_ };
+    const double dir[3] = { ray.direction_.x_, ray.direction_.y_,
+                            ray.direction_.z_ };
+    const double box_min[3] = { min_.x_, min_.y_, min_.z_ };
+    const double box_max[3] = { max_.x_, max_.y_, max_.z_ };
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double inv_d = 1.0 / dir[axis];
+        double t0 = (box_min[axis] - origin[axis]) * inv_d;
+        double t1 = (box_max[axis] - origin[axis]) * inv_d;
+        if (inv_d < 0)
+            std::swap(t0, t1);
+
+        // NaN (origin on a slab with a null direction) keeps the interval
+        if (t0 > ray_t.min_)
+            ray_t.min_ = t0;
+        if (t1 < ray_t.max_)
+            ray_t.max_ = t1;
+
+        if (ray_t.max_ < ray_t.min_)
+            return false;
+    }
+
+    return true;
+}
+
+AABB AABB::pad(double delta) const
+{
+    Vector3 d(delta, delta, delta);
+    return AABB(min_ - d, max_ + d);
+}
+
+AABB AABB::surrounding(const AABB &box1, const AABB &box2)
+{
+    return AABB(Point3(std::min(box1.min_.x_, box2.min_.x_),
+                       std::min(box1.min_.y_, box2.min_.y_),
+                       std::min(box1.min_.z_, box2.min_.z_)),
+                Point3(std::max(box1.max_.x_, box2.max_.x_),
+                       std::max(box1.max_.y_, box2.max_.y_),
+                       std::max(box1.max_.z_, box2.max_.z_)));
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "interval.hh"
+#include "ray.hh"
+#include "vector3.hh"
+
+// Axis-aligned bounding box, used to cull rays before testing real geometry
+class AABB
+{
+public:
+    Point3 min_;
+    Point3 max_;
+
+    AABB(); // empty box
+    AABB(const Point3 &min, const Point3 &max);
+
+    // Slab test, ray_t is shrunk to the part of the ray inside the box
+    bool hit(const Ray &ray, Interval &ray_t) const;
+
+    AABB pad(double delta) const;
+
+    static AABB surrounding(const AABB &box1, const AABB &box2);
+};
@@ -0,0 +1,246 @@
+#include "bvh.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "utils.hh"
+
+static double centroid_on_axis(const AABB &box, int axis)
+{
+    double min = axis == 0 ? box.min_.x_ : axis == 1 ? box.min_.y_ : box.min_.z_;
+    double max = axis == 0 ? box.max_.x_ : axis == 1 ? box.max_.y_ : box.max_.z_;
+    return (min + max) / 2;
+}
+
+// false for infinite extents (planes), and for empty boxes
+static bool is_bounded(const AABB &box)
+{
+    return std::isfinite(box.min_.x_) && std::isfinite(box.min_.y_)
+        && std::isfinite(box.min_.z_) && std::isfinite(box.max_.x_)
+        && std::isfinite(box.max_.y_) && std::isfinite(box.max_.z_);
+}
+
+BVH::BVH()
+    : nodes_()
+    , objects_()
+    , unbounded_objects_()
+{}
+
+BVH::BVH(const std::list<std::shared_ptr<PhysObj>> &objects)
+    : nodes_()
+    , objects_()
+    , unbounded_objects_()
+{
+    std::vector<AABB> boxes;
+    for (auto const &object : objects)
+    {
+        AABB box = object->bounding_box();
+        if (is_bounded(box))
+        {
+            objects_.push_back(object);
+            boxes.push_back(box);
+        }
+        else
+            unbounded_objects_.push_back(object);
+    }
+
+    if (objects_.empty())
+        return;
+
+    nodes_.reserve(2 * objects_.size());
+    build(boxes, 0, objects_.size(), 0);
+}
+
+// Median split along the axis on which object centroids are the most spread
+int BVH::build(std::vector<AABB> &boxes, int start, int end, int depth)
+{
+    int node_index = nodes_.size();
+    nodes_.push_back(Node{ AABB(), -1, start, end - start });
+
+    AABB box;
+    double centroid_min[3] = { utils::infinity, utils::infinity,
+                               utils::infinity };
+    double centroid_max[3] = { -utils::infinity, -utils::infinity,
+                               -utils::infinity };
+    for (int i = start; i < end; i++)
+    {
+        box = AABB::surrounding(box, boxes[i]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double c = centroid_on_axis(boxes[i], axis);
+            centroid_min[axis] = std::min(centroid_min[axis], c);
+            centroid_max[axis] = std::max(centroid_max[axis], c);
+        }
+    }
+    nodes_[node_index].box_ = box;
+
+    if (end - start <= max_leaf_size || depth == max_depth)
+        return node_index;
+
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        if (centroid_max[i] - centroid_min[i]
+            > centroid_max[axis] - centroid_min[axis])
+            axis = i;
+    }
+
+    // Sort objects and their boxes together through an index permutation
+    std::vector<int> order(end - start);
+    std::iota(order.begin(), order.end(), start);
+    int mid = (start + end) / 2;
+    std::nth_element(order.begin(), order.begin() + (mid - start), order.end(),
+                     [&boxes, axis](int a, int b) {
+                         return centroid_on_axis(boxes[a], axis)
+                             < centroid_on_axis(boxes[b], axis);
+                     });
+
+    std::vector<AABB> sorted_boxes;
+    std::vector<std::shared_ptr<PhysObj>> sorted_objects;
+    for (int i : order)
+    {
+        sorted_boxes.push_back(boxes[i]);
+        sorted_objects.push_back(objects_[i]);
+    }
+    std::copy(sorted_boxes.begin(), sorted_boxes.end(), boxes.begin() + start);
+    std::copy(sorted_objects.begin(), sorted_objects.end(),
+              objects_.begin() + start);
+
+    nodes_[node_index].count_ = 0;
+    build(boxes, start, mid, depth + 1);
+    int right = build(boxes, mid, end, depth + 1);
+    nodes_[node_index].right_ = right;
+
+    return node_index;
+}
+
+bool BVH::hit(const Ray &ray, HitRecord &hit_record) const
+{
+    HitRecord closest_hit_record;
+    closest_hit_record.t = utils::infinity;
+    bool hit_anything = false;
+
+    for (auto const &object : unbounded_objects_)
+    {
+        HitRecord object_hit_record;
+        if (object->hit(ray, object_hit_record)
+            && object_hit_record.t < closest_hit_record.t)
+        {
+            closest_hit_record = object_hit_record;
+            hit_anything = true;
+        }
+    }
+
+    // A node and the siblings of its ancestors at most (one per depth)
+    int stack[max_depth + 1];
+    int stack_size = 0;
+    if (!nodes_.empty())
+        stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        int node_index = stack[--stack_size];
+        const Node &node = nodes_[node_index];
+
+        Interval ray_t(0, closest_hit_record.t);
+        if (!node.box_.hit(ray, ray_t))
+            continue;
+
+        if (node.count_ > 0)
+        {
+            for (int i = node.first_; i < node.first_ + node.count_; i++)
+            {
+                HitRecord object_hit_record;
+                if (objects_[i]->hit(ray, object_hit_record)
+                    && object_hit_record.t < closest_hit_record.t)
+                {
+                    closest_hit_record = object_hit_record;
+                    hit_anything = true;
+                }
+            }
+            continue;
+        }
+
+        int left = node_index + 1;
+        int right = node.right_;
+
+        // Push the farthest child first so that the nearest one is visited
+        // first and shrinks the interval for the other
+        Interval left_t(0, closest_hit_record.t);
+        Interval right_t(0, closest_hit_record.t);
+        bool hit_left = nodes_[left].box_.hit(ray, left_t);
+        bool hit_right = nodes_[right].box_.hit(ray, right_t);
+
+        if (hit_left && hit_right)
+        {
+            if (left_t.min_ <= right_t.min_)
+            {
+                stack[stack_size++] = right;
+                stack[stack_size++] = left;
+            }
+            else
+            {
+                stack[stack_size++] = left;
+                stack[stack_size++] = right;
+            }
+        }
+        else if (hit_left)
+            stack[stack_size++] = left;
+        else if (hit_right)
+            stack[stack_size++] = right;
+    }
+
+    if (!hit_anything)
+        return false;
+
+    hit_record = closest_hit_record;
+    return true;
+}
+
+bool BVH::hit_any(const Ray &ray, const PhysObj *skipped) const
+{
+    for (auto const &object : unbounded_objects_)
+    {
+        if (object.get() == skipped)
+            continue;
+
+        HitRecord object_hit_record;
+        if (object->hit(ray, object_hit_record))
+            return true;
+    }
+
+    int stack[max_depth + 1];
+    int stack_size = 0;
+    if (!nodes_.empty())
+        stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        int node_index = stack[--stack_size];
+        const Node &node = nodes_[node_index];
+
+        Interval ray_t(0, utils::infinity);
+        if (!node.box_.hit(ray, ray_t))
+            continue;
+
+        if (node.count_ > 0)
+        {
+            for (int i = node.first_; i < node.first_ + node.count_; i++)
+            {
+                if (objects_[i].get() == skipped)
+                    continue;
+
+                HitRecord object_hit_record;
+                if (objects_[i]->hit(ray, object_hit_record))
+                    return true;
+            }
+            continue;
+        }
+
+        stack[stack_size++] = node.right_;
+        stack[stack_size++] = node_index + 1;
+    }
+
+    return false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "aabb.hh"
+#include "physobj.hh"
+#include "ray.hh"
+
+// Bounding volume hierarchy over the objects of a scene
+// Nodes are stored in a flat array (depth-first order, left child right after
+// its parent) so that traversal does not chase pointers. Objects with an
+// infinite box (planes) would make every ray enter the tree, they are kept
+// aside and tested against every ray
+class BVH
+{
+public:
+    struct Node
+    {
+        AABB box_;
+        int right_; // index of the right child (inner nodes)
+        int first_; // index of the first object (leaves)
+        int count_; // number of objects, 0 for inner nodes
+    };
+
+    static constexpr int max_leaf_size = 2;
+
+    // Nodes deeper than this are leaves whatever their size (bounds the
+    // traversal stack, a median split only reaches it with 2^63 objects)
+    static constexpr int max_depth = 63;
+
+    std::vector<Node> nodes_;
+    std::vector<std::shared_ptr<PhysObj>> objects_; // bounded, in the tree
+    std::vector<std::shared_ptr<PhysObj>> unbounded_objects_;
+
+    BVH();
+    BVH(const std::list<std::shared_ptr<PhysObj>> &objects);
+
+    // Closest hit along the ray
+    bool hit(const Ray &ray, HitRecord &hit_record) const;
+
+    // Any hit along the ray, stops at the first one found, skipped is ignored
+    bool hit_any(const Ray &ray, const PhysObj *skipped = nullptr) const;
+
+private:
+    int build(std::vector<AABB> &boxes, int start, int end, int depth);
+};
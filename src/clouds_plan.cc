@@ -39,11 +39,21 @@ bool CloudsPlan::hit(const Ray &ray, HitRecord &hit_record) const
 
     hit_record.t = t;
     hit_record.p = p;
-    hit_record.n = n_;
-    hit_record.tex = get_texture_at(p);
+    hit_record.obj = this;
     return true;
 }
 
+void CloudsPlan::fill_shading(HitRecord &hit_record) const
+{
+    hit_record.n = n_;
+    hit_record.tex = get_texture_at(hit_record.p);
+}
+
+AABB CloudsPlan::bounding_box() const
+{
+    return horizontal_plane_box(clouds_height_);
+}
+
 LocalTexture CloudsPlan::get_texture_at(const Point3 &p) const
 {
     LocalTexture tex;
@@ -16,6 +16,9 @@ public:
                double clouds_scale, double clouds_max_opacity);
 
     bool hit(const Ray &ray, HitRecord &hit_record) const override;
+    void fill_shading(HitRecord &hit_record) const override;
+
+    AABB bounding_box() const override;
 
     void translate(const Vector3 &v) override;
 
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+
+#include "dla_generator.hh"
+#include "dla_walker_group.hh"
+#include "heightmap.hh"
+
+// DLA scaling benchmark: generate the same DLA heightmap (fixed seed) for each width from 64 to 2048, and write the
+// time of each phase, the walker steps, the neighbour queries and the peak memory of each level as JSON, with the
+// growth exponents fitted on the widths (time ~ width^exponent).
+
+using PhaseSeconds = double DLA::LevelStats::*;
+
+static const std::pair<const char*, PhaseSeconds> phases[] = {
+    { "populate", &DLA::LevelStats::populate_seconds },
+    { "upscale_graph", &DLA::LevelStats::upscale_graph_seconds },
+    { "set_graph_height_values", &DLA::LevelStats::height_values_seconds },
+    { "upscale_blurry_grid", &DLA::LevelStats::upscale_blurry_grid_seconds },
+    { "graph_to_heightmap", &DLA::LevelStats::graph_to_heightmap_seconds },
+    { "output", &DLA::LevelStats::output_seconds },
+};
+
+struct BenchmarkRun
+{
+    int width;
+    double seconds; /**< whole generateUpscaledHeightmap() */
+    std::vector<DLA::LevelStats> levels;
+};
+
+/**
+ * @brief Start measuring the peak resident memory from now on (resets VmHWM on Linux, see clear_refs in proc(5)).
+ */
+static void resetPeakMemory() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+/**
+ * @return peak resident memory of the process since the last resetPeakMemory(), in KB (since the start of the
+ * process if it could not be reset)
+ */
+static long peakMemoryKB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with("VmHWM:")) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // KB on Linux
+}
+
+void showHelpMenu(char* argv[]) {
+    std::cout << "Usage: " << argv[0] << " [-n <min_width>] [-m <max_width>] [-s <seed>] [-j <threads>] [-d] [-b] [-v] [-o <output_filename>] [-h]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -n <min_width>        Smallest heightmap width (default is 64)" << std::endl;
+    std::cout << "  -m <max_width>        Largest heightmap width (default is 2048)" << std::endl;
+    std::cout << "  -s <seed>             Seed of the generator (default is 10)" << std::endl;
+    std::cout << "  -j <threads>          Number of threads simulating DLA walkers (default is 0, one walker at a time)" << std::endl;
+    std::cout << "  -d                    Walkers far from the graph jump using the distance field (default is unit steps)" << std::endl;
+    std::cout << "  -b                    Spawn walkers on a band around the graph (default is anywhere)" << std::endl;
+    std::cout << "  -v                    Move walkers by SIMD groups (with -j)" << std::endl;
+    std::cout << "  -o <output_filename>  Specify the path to the JSON report (default is ../images/DLA/dla_benchmark.json)" << std::endl;
+    std::cout << "  -h                    Show this help menu" << std::endl;
+}
+
+/**
+ * @brief Least squares fit of log(value) = exponent * log(width) + log(factor), on the positive values.
+ *
+ * @param[in] widths  widths of the runs
+ * @param[in] values  measure of each run
+ *
+ * @return { exponent, factor }, { NAN, NAN } with less than 2 positive values
+ */
+static std::pair<double, double> fitGrowth(const std::vector<double>& widths, const std::vector<double>& values) {
+    double n = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+
+    for (size_t i = 0; i < widths.size(); i++) {
+        if (values[i] <= 0) {
+            continue;
+        }
+
+        double x = std::log(widths[i]);
+        double y = std::log(values[i]);
+        n++;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    double denominator = n * sum_xx - sum_x * sum_x;
+    if (n < 2 || denominator == 0) {
+        return { NAN, NAN };
+    }
+
+    double exponent = (n * sum_xy - sum_x * sum_y) / denominator;
+    double factor = std::exp((sum_y - exponent * sum_x) / n);
+    return { exponent, factor };
+}
+
+// JSON has no NaN
+static std::string jsonNumber(double value) {
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+
+    std::ostringstream stream;
+    stream << std::setprecision(6) << value;
+    return stream.str();
+}
+
+/**
+ * @brief Write the runs, the growth exponents of the phases and counters, and the predicted time of larger widths.
+ */
+static void writeReport(std::ostream& out, const std::vector<BenchmarkRun>& runs, int seed, const DLA::DLAGenerator& config) {
+    out << "{\n";
+    out << "  \"seed\": " << seed << ",\n";
+    out << "  \"density_threshold\": " << jsonNumber(config.density_threshold_) << ",\n";
+    out << "  \"aggregation_threads\": " << config.aggregation_threads_ << ",\n";
+    out << "  \"walk_mode\": \"" << (config.walk_mode_ == DLA::WalkMode::DISTANCE_FIELD_JUMPS ? "distance_field_jumps" : "unit_steps") << "\",\n";
+    out << "  \"spawn_mode\": \"" << (config.spawn_mode_ == DLA::SpawnMode::AGGREGATE_BAND ? "aggregate_band" : "uniform") << "\",\n";
+    out << "  \"walker_kernel\": \"" << (config.simd_walkers_ && config.aggregation_threads_ > 0 ? DLA::WalkerGroup::kernelName() : "none") << "\",\n";
+
+    out << "  \"runs\": [\n";
+    for (size_t r = 0; r < runs.size(); r++) {
+        const BenchmarkRun& run = runs[r];
+        out << "    {\n";
+        out << "      \"width\": " << run.width << ",\n";
+        out << "      \"seconds\": " << jsonNumber(run.seconds) << ",\n";
+        out << "      \"levels\": [\n";
+
+        for (size_t l = 0; l < run.levels.size(); l++) {
+            const DLA::LevelStats& level = run.levels[l];
+            out << "        { \"width\": " << level.width << ", \"nodes\": " << level.nodes;
+            for (const auto& [name, seconds] : phases) {
+                out << ", \"" << name << "_seconds\": " << jsonNumber(level.*seconds);
+            }
+            out << ", \"walk_steps\": " << level.walk_steps << ", \"neighbour_queries\": " << level.neighbour_queries
+                << ", \"peak_memory_kb\": " << level.peak_memory_kb << " }" << (l + 1 < run.levels.size() ? "," : "") << "\n";
+        }
+
+        out << "      ]\n";
+        out << "    }" << (r + 1 < runs.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+
+    // measures of each run (summed over its levels, largest peak memory of its levels)
+    std::vector<double> widths;
+    std::vector<std::pair<std::string, std::vector<double>>> measures = { { "seconds", {} } };
+    for (const auto& [name, seconds] : phases) {
+        measures.push_back({ std::string(name) + "_seconds", {} });
+    }
+    measures.push_back({ "walk_steps", {} });
+    measures.push_back({ "neighbour_queries", {} });
+    measures.push_back({ "peak_memory_kb", {} });
+
+    for (const BenchmarkRun& run : runs) {
+        widths.push_back(run.width);
+
+        size_t m = 0;
+        measures[m++].second.push_back(run.seconds);
+        for (const auto& phase : phases) {
+            double total = 0;
+            for (const DLA::LevelStats& level : run.levels) {
+                total += level.*phase.second;
+            }
+            measures[m++].second.push_back(total);
+        }
+
+        double walk_steps = 0, neighbour_queries = 0, peak_memory_kb = 0;
+        for (const DLA::LevelStats& level : run.levels) {
+            walk_steps += level.walk_steps;
+            neighbour_queries += level.neighbour_queries;
+            peak_memory_kb = std::max<double>(peak_memory_kb, level.peak_memory_kb);
+        }
+        measures[m++].second.push_back(walk_steps);
+        measures[m++].second.push_back(neighbour_queries);
+        measures[m++].second.push_back(peak_memory_kb);
+    }
+
+    out << "  \"growth_exponents\": {\n";
+    for (size_t m = 0; m < measures.size(); m++) {
+        out << "    \"" << measures[m].first << "\": " << jsonNumber(fitGrowth(widths, measures[m].second).first) << (m + 1 < measures.size() ? "," : "") << "\n";
+    }
+    out << "  },\n";
+
+    auto [exponent, factor] = fitGrowth(widths, measures[0].second);
+    out << "  \"predicted_seconds\": {\n";
+    for (int width = 4096; width <= 8192; width *= 2) {
+        out << "    \"" << width << "\": " << jsonNumber(factor * std::pow(width, exponent)) << (width < 8192 ? "," : "") << "\n";
+    }
+    out << "  }\n";
+    out << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+    char opt;
+
+    int min_width = 64;
+    int max_width = 2048;
+    int seed = 10;
+    int aggregation_threads = 0;
+    DLA::WalkMode walk_mode = DLA::WalkMode::UNIT_STEPS;
+    DLA::SpawnMode spawn_mode = DLA::SpawnMode::UNIFORM;
+    bool simd_walkers = false;
+    std::string output_filename = "../images/DLA/dla_benchmark.json";
+
+    while ((opt = getopt(argc, argv, "n:m:s:j:dbvo:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                min_width = std::atoi(optarg);
+                break;
+            case 'm':
+                max_width = std::atoi(optarg);
+                break;
+            case 's':
+                seed = std::atoi(optarg);
+                break;
+            case 'j':
+                aggregation_threads = std::atoi(optarg);
+                if (aggregation_threads < 0) {
+                    std::cerr << "Error: Invalid number of threads. Please use a positive integer (or 0)." << std::endl;
+                    return 1;
+                }
+                break;
+            case 'd':
+                walk_mode = DLA::WalkMode::DISTANCE_FIELD_JUMPS;
+                break;
+            case 'b':
+                spawn_mode = DLA::SpawnMode::AGGREGATE_BAND;
+                break;
+            case 'v':
+                simd_walkers = true;
+                break;
+            case 'o':
+                output_filename = optarg;
+                break;
+            case 'h':
+                showHelpMenu(argv);
+                return 0;
+            default:
+                showHelpMenu(argv);
+                return 1;
+        }
+    }
+
+    for (int width : { min_width, max_width }) {
+        if (width < 16 || (width & (width - 1)) != 0) {
+            std::cerr << "Error: Invalid DLA width. Please use a power of 2 (>= 16)." << std::endl;
+            return 1;
+        }
+    }
+
+    // parameters of every run (for the report)
+    DLA::DLAGenerator config = DLA::DLAGenerator(0.6f, 0.5f, 0.5f, seed);
+    config.walk_mode_ = walk_mode;
+    config.spawn_mode_ = spawn_mode;
+    config.aggregation_threads_ = aggregation_threads;
+    config.simd_walkers_ = simd_walkers;
+
+    std::vector<BenchmarkRun> runs;
+
+    for (int width = min_width; width <= max_width; width *= 2) {
+        DLA::DLAGenerator generator = DLA::DLAGenerator(config.density_threshold_, config.graph_center_y_, config.graph_center_x_, seed);
+        generator.walk_mode_ = config.walk_mode_;
+        generator.spawn_mode_ = config.spawn_mode_;
+        generator.aggregation_threads_ = config.aggregation_threads_;
+        generator.simd_walkers_ = config.simd_walkers_;
+        generator.debug_files_ = false;
+        generator.level_start_hook_ = resetPeakMemory;
+        generator.level_end_hook_ = [](DLA::LevelStats& stats) { stats.peak_memory_kb = peakMemoryKB(); };
+
+        auto start = std::chrono::steady_clock::now();
+        Heightmap heightmap = generator.generateUpscaledHeightmap(width);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        runs.push_back({ width, elapsed.count(), generator.level_stats_ });
+        std::cout << "DLA " << width << ": " << elapsed.count() << " seconds, " << generator.walk_steps_ << " walker moves, "
+                  << generator.neighbour_queries_ << " neighbour queries" << std::endl;
+    }
+
+    std::ofstream file(output_filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << output_filename << std::endl;
+        return 1;
+    }
+
+    writeReport(file, runs, seed, config);
+    std::cout << "Report written to " << output_filename << std::endl;
+
+    return 0;
+}
@@ -3,20 +3,24 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdint>
 #include <cmath>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <limits>
-#include <queue>
 #include <memory>
-#include <set>
+#include <span>
+#include <sstream>
 #include <vector>
 
 #include "dla_graph.hh"
+#include "dla_walker_group.hh"
 #include "heightmap.hh"
 #include "utils.hh"
 
 #include "image2d.hh"
+#include "thread_pool.hh"
 
 // Implementation of DLA Algorithm (intuition from https://youtu.be/gsJHzBTPG0Y?si=jipP7Z0xBVCW3Ip6):
 // algorithm bounded to CPU by nature (but we dont care)
@@ -27,11 +31,21 @@ std::uniform_real_distribution<float> DLAGenerator::real_dist_1_(0.5f, 1.0f);
 std::uniform_real_distribution<float> DLAGenerator::real_dist_1_zero_centered_(-1.0f, 1.0f);
 std::uniform_real_distribution<float> DLAGenerator::real_dist_2pi_(0.0f, 2 * utils::pi);
 
+static constexpr char kCheckpointMagic[8] = { 'D', 'L', 'A', 'C', 'K', 'P', 'T', 2 }; // last byte is the format version
+
 DLAGenerator::DLAGenerator()
     : rng_(rd_())
     , density_threshold_(0.5f)
     , graph_center_y_(0.5f)
     , graph_center_x_(0.5f)
+    , walk_mode_(WalkMode::UNIT_STEPS)
+    , spawn_mode_(SpawnMode::UNIFORM)
+    , walk_steps_(0)
+    , neighbour_queries_(0)
+    , checkpoint_interval_(0.0)
+    , aggregation_threads_(0)
+    , simd_walkers_(false)
+    , debug_files_(true)
 {}
 
 DLAGenerator::DLAGenerator(float density_threshold)
@@ -39,6 +53,14 @@ DLAGenerator::DLAGenerator(float density_threshold)
     , density_threshold_(density_threshold)
     , graph_center_y_(0.5f)
     , graph_center_x_(0.5f)
+    , walk_mode_(WalkMode::UNIT_STEPS)
+    , spawn_mode_(SpawnMode::UNIFORM)
+    , walk_steps_(0)
+    , neighbour_queries_(0)
+    , checkpoint_interval_(0.0)
+    , aggregation_threads_(0)
+    , simd_walkers_(false)
+    , debug_files_(true)
 {}
 
 DLAGenerator::DLAGenerator(float density_threshold, int seed)
@@ -46,11 +68,27 @@ DLAGenerator::DLAGenerator(float density_threshold, int seed)
     , density_threshold_(density_threshold)
     , graph_center_y_(0.5f)
     , graph_center_x_(0.5f)
+    , walk_mode_(WalkMode::UNIT_STEPS)
+    , spawn_mode_(SpawnMode::UNIFORM)
+    , walk_steps_(0)
+    , neighbour_queries_(0)
+    , checkpoint_interval_(0.0)
+    , aggregation_threads_(0)
+    , simd_walkers_(false)
+    , debug_files_(true)
 {}
 
 DLAGenerator::DLAGenerator(float density_threshold, float graph_center_y, float graph_center_x, int seed)
     : rng_(seed)
     , density_threshold_(density_threshold)
+    , walk_mode_(WalkMode::UNIT_STEPS)
+    , spawn_mode_(SpawnMode::UNIFORM)
+    , walk_steps_(0)
+    , neighbour_queries_(0)
+    , checkpoint_interval_(0.0)
+    , aggregation_threads_(0)
+    , simd_walkers_(false)
+    , debug_files_(true)
 {
     if (graph_center_y < 0.0f || graph_center_y >= 1.0f || graph_center_x < 0.0f || graph_center_x >= 1.0f) {
         throw std::runtime_error("DLAGenerator: DLAGenerator: Graph center must be in the range [0.0, 1.0)");
@@ -83,45 +121,588 @@ std::array<float, 2> DLAGenerator::getRandom2DPixelCoordinates(int width, int he
     return { height_pos, width_pos };
 }
 
+/**
+ * @brief Coarse lower bound of the distance to the closest graph node, on cells of kCellSize x kCellSize pixels.
+ * Distances are capped to kMaxDistance, so that adding a node only updates the cells close to it.
+ */
+class DistanceField
+{
+public:
+    static constexpr int kCellSize = 2;
+    static constexpr float kMaxDistance = 8.0f;
+
+    DistanceField(int width, const Graph& graph)
+        : cells_((width + kCellSize - 1) / kCellSize)
+        , field_(cells_ * cells_, kMaxDistance)
+    {
+        for (size_t i = 1; i < graph.size(); i++) {
+            addNode(graph.y_[i], graph.x_[i]);
+        }
+    }
+
+    /**
+     * @brief Lower the bound of the cells around a new node.
+     *
+     * @param[in] y  y coordinate of the node
+     * @param[in] x  x coordinate of the node
+     */
+    void addNode(float y, float x) {
+        // any point of a cell is at most half a diagonal away from its center
+        const float half_diagonal = kCellSize * std::sqrt(2.0f) / 2;
+        const int reach = std::ceil((kMaxDistance + half_diagonal) / kCellSize);
+
+        int node_row = static_cast<int>(y) / kCellSize;
+        int node_col = static_cast<int>(x) / kCellSize;
+
+        for (int row = std::max(0, node_row - reach); row <= std::min(cells_ - 1, node_row + reach); row++) {
+            for (int col = std::max(0, node_col - reach); col <= std::min(cells_ - 1, node_col + reach); col++) {
+                float center_y = (row + 0.5f) * kCellSize;
+                float center_x = (col + 0.5f) * kCellSize;
+                float distance = utils::euclidianDistance(y, x, center_y, center_x) - half_diagonal;
+
+                float& bound = field_[row * cells_ + col];
+                bound = std::min(bound, std::max(distance, 0.0f));
+            }
+        }
+    }
+
+    /**
+     * @param[in] y  y coordinate (inside the grid)
+     * @param[in] x  x coordinate (inside the grid)
+     *
+     * @return a lower bound of the distance between the given coordinates and the closest graph node
+     */
+    float lowerBoundAt(float y, float x) const {
+        return field_[(static_cast<int>(y) / kCellSize) * cells_ + static_cast<int>(x) / kCellSize];
+    }
+
+private:
+    int cells_; /**< number of cells along each axis */
+    std::vector<float> field_;
+};
+
+/**
+ * @brief Where walkers are spawned with SpawnMode::AGGREGATE_BAND: on the free cells (1x1 cells without any node) of a
+ * band just outside the circle around the graph center that contains every node, or on any free cell when the band is
+ * out of the grid (or full). Free cells are kept in lists (by ring around the center, and all of them) so that a
+ * spawn cell is picked in constant time instead of drawing positions until one is far enough from the nodes.
+ */
+class SpawnRegion
+{
+public:
+    static constexpr float kSpawnMargin = 2.0f; /**< distance between the aggregate circle and the band */
+    static constexpr int kBandWidth = 2; /**< number of rings (1 wide) of the band */
+
+    SpawnRegion(int width, float center_y, float center_x, const Graph& graph, size_t first_new_label)
+        : width_(width)
+        , center_y_(center_y)
+        , center_x_(center_x)
+        , radius_(0.0f)
+        , free_index_(width * width)
+        , ring_index_(width * width)
+    {
+        std::vector<bool> occupied(width * width, false);
+        for (size_t i = 1; i < std::min(first_new_label, graph.size()); i++) {
+            occupied[cellOf(graph.y_[i], graph.x_[i])] = true;
+            radius_ = std::max(radius_, utils::euclidianDistance(graph.y_[i], graph.x_[i], center_y_, center_x_));
+        }
+
+        for (int cell = 0; cell < width * width; cell++) {
+            free_index_[cell] = -1;
+            ring_index_[cell] = -1;
+
+            if (!occupied[cell]) {
+                free_index_[cell] = free_cells_.size();
+                free_cells_.push_back(cell);
+
+                size_t ring_number = ringOf(cell);
+                if (ring_number >= ring_cells_.size()) {
+                    ring_cells_.resize(ring_number + 1);
+                }
+
+                std::vector<int>& ring = ring_cells_[ring_number];
+                ring_index_[cell] = ring.size();
+                ring.push_back(cell);
+            }
+        }
+
+        // removing cells changes the order of the lists, so nodes added since first_new_label are removed one by one
+        for (size_t i = first_new_label; i < graph.size(); i++) {
+            addNode(graph.y_[i], graph.x_[i]);
+        }
+    }
+
+    /**
+     * @brief Pick a spawn position (not checked against the nodes of neighbouring cells).
+     *
+     * @param[in, out] random  random generator of the walker
+     *
+     * @return random position in a free cell of the band (or of the grid)
+     */
+    template <typename Random>
+    std::array<float, 2> spawn(Random& random) const {
+        std::uniform_real_distribution<float> dist_offset(0.0f, 1.0f);
+
+        int cell = -1;
+        size_t band_count = bandCount();
+
+        if (band_count > 0) {
+            size_t k = std::uniform_int_distribution<size_t>(0, band_count - 1)(random);
+            for (int ring = firstBandRing(); ring < lastBandRing(); ring++) {
+                if (k < ring_cells_[ring].size()) {
+                    cell = ring_cells_[ring][k];
+                    break;
+                }
+                k -= ring_cells_[ring].size();
+            }
+        } else if (!free_cells_.empty()) {
+            cell = free_cells_[std::uniform_int_distribution<size_t>(0, free_cells_.size() - 1)(random)];
+        } else {
+            cell = std::uniform_int_distribution<int>(0, width_ * width_ - 1)(random);
+        }
+
+        float y = cell / width_ + dist_offset(random);
+        float x = cell % width_ + dist_offset(random);
+        return { std::min(y, std::nextafter(static_cast<float>(width_), 0.0f)), std::min(x, std::nextafter(static_cast<float>(width_), 0.0f)) };
+    }
+
+    /**
+     * @param[in] y  y coordinate of a walker
+     * @param[in] x  x coordinate of a walker
+     *
+     * @return true if the walker went so far from the graph that it should be spawned again on the band
+     */
+    bool strayed(float y, float x) const {
+        float kill_radius = std::max(2 * (radius_ + kSpawnMargin), radius_ + kSpawnMargin + 8 * kBandWidth);
+        return utils::euclidianDistance(y, x, center_y_, center_x_) > kill_radius && bandCount() > 0;
+    }
+
+    /**
+     * @brief Remove the cell of a new node from the free cells and grow the aggregate circle if needed.
+     *
+     * @param[in] y  y coordinate of the node
+     * @param[in] x  x coordinate of the node
+     */
+    void addNode(float y, float x) {
+        radius_ = std::max(radius_, utils::euclidianDistance(y, x, center_y_, center_x_));
+
+        int cell = cellOf(y, x);
+        if (free_index_[cell] == -1) {
+            return;
+        }
+
+        removeFromList(free_cells_, free_index_, cell);
+        removeFromList(ring_cells_[ringOf(cell)], ring_index_, cell);
+    }
+
+private:
+    int cellOf(float y, float x) const {
+        int row = std::clamp(static_cast<int>(y), 0, width_ - 1);
+        int col = std::clamp(static_cast<int>(x), 0, width_ - 1);
+        return row * width_ + col;
+    }
+
+    int ringOf(int cell) const {
+        float y = cell / width_ + 0.5f;
+        float x = cell % width_ + 0.5f;
+        return static_cast<int>(utils::euclidianDistance(y, x, center_y_, center_x_));
+    }
+
+    int firstBandRing() const { return std::min(static_cast<int>(std::ceil(radius_ + kSpawnMargin)), static_cast<int>(ring_cells_.size())); }
+    int lastBandRing() const { return std::min(firstBandRing() + kBandWidth, static_cast<int>(ring_cells_.size())); }
+
+    size_t bandCount() const {
+        size_t count = 0;
+        for (int ring = firstBandRing(); ring < lastBandRing(); ring++) {
+            count += ring_cells_[ring].size();
+        }
+        return count;
+    }
+
+    // swap with the last cell of the list, then pop
+    static void removeFromList(std::vector<int>& list, std::vector<int>& index, int cell) {
+        int last = list.back();
+        list[index[cell]] = last;
+        index[last] = index[cell];
+        list.pop_back();
+        index[cell] = -1;
+    }
+
+    int width_;
+    float center_y_;
+    float center_x_;
+    float radius_; /**< distance between the center and the farthest node */
+    std::vector<int> free_cells_;
+    std::vector<int> free_index_; /**< position of each cell in free_cells_, -1 if it holds a node */
+    std::vector<std::vector<int>> ring_cells_; /**< free cells by ring (distance between the cell center and the center, floored) */
+    std::vector<int> ring_index_; /**< position of each cell in its ring list, -1 if it holds a node */
+};
+
+/**
+ * @brief Counter-based random generator (SplitMix64): the numbers drawn only depend on the key, so a walker draws
+ * the same numbers whatever the thread simulating it. Satisfies UniformRandomBitGenerator.
+ */
+class WalkerRandom
+{
+public:
+    using result_type = std::uint64_t;
+
+    WalkerRandom(std::uint64_t key)
+        : counter_(key)
+    {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+        counter_ += 0x9E3779B97F4A7C15ull;
+        return mix(counter_);
+    }
+
+    static std::uint64_t mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    std::uint64_t counter_;
+};
+
+/**
+ * @brief Statistics of walkers, added to DLAGenerator::walk_steps_ and DLAGenerator::neighbour_queries_.
+ */
+struct WalkerCounts
+{
+    long long steps = 0; /**< moves */
+    long long neighbour_queries = 0; /**< Graph::hasNodesAround() and Graph::getNodesAround() calls */
+};
+
+/**
+ * @brief Graph::hasNodesAround(), counted in neighbour_queries.
+ */
+static bool countedHasNodesAround(const Graph& graph, float y, float x, float radius, long long& neighbour_queries) {
+    neighbour_queries++;
+    return graph.hasNodesAround(y, x, radius);
+}
+
+/**
+ * @brief Graph::getNodesAround(), counted in neighbour_queries.
+ */
+static std::vector<int> countedGetNodesAround(const Graph& graph, float y, float x, float radius, long long& neighbour_queries) {
+    neighbour_queries++;
+    return graph.getNodesAround(y, x, radius);
+}
+
+/**
+ * @brief Draw a walker start position that is not too close to a node (same rule as DLAGenerator::populateGraph()).
+ *
+ * @param[in] width         square grid width
+ * @param[in] graph         DLA graph
+ * @param[in] spawn_region  where to spawn the walker, nullptr for anywhere on the grid
+ * @param[in, out] random   random generator of the walker
+ * @param[in, out] neighbour_queries  number of graph queries
+ *
+ * @return start coordinates
+ */
+static std::array<float, 2> spawnWalker(int width, const Graph& graph, const SpawnRegion* spawn_region, WalkerRandom& random, long long& neighbour_queries) {
+    std::uniform_real_distribution<float> dist_position(0.0f, width);
+
+    float y, x;
+    do {
+        if (spawn_region) {
+            std::array<float, 2> position = spawn_region->spawn(random);
+            y = position[0];
+            x = position[1];
+        } else {
+            y = dist_position(random);
+            x = dist_position(random);
+        }
+    } while (y >= width || x >= width || countedHasNodesAround(graph, y, x, 0.1, neighbour_queries));
+
+    return { y, x };
+}
+
+/**
+ * @brief Spawn a walker and move it until it is next to a node of the graph (same walk as DLAGenerator::populateGraph()).
+ * Only reads the graph and the distance field, so several walkers can be simulated concurrently.
+ *
+ * @param[in] width           square grid width
+ * @param[in] graph           DLA graph (not modified)
+ * @param[in] distance_field  distance field to jump far from the graph, nullptr for unit steps only
+ * @param[in] spawn_region    where to spawn the walker, nullptr for anywhere on the grid
+ * @param[in, out] random     random generator of the walker
+ * @param[out] counts         moves and graph queries of the walker
+ *
+ * @return coordinates where the walker stuck
+ */
+static std::array<float, 2> walkUntilStuck(int width, const Graph& graph, const DistanceField* distance_field, const SpawnRegion* spawn_region, WalkerRandom& random, WalkerCounts& counts) {
+    std::uniform_real_distribution<float> dist_2pi(0.0f, 2 * utils::pi);
+
+    counts = WalkerCounts();
+
+    auto spawn = [&]() { return spawnWalker(width, graph, spawn_region, random, counts.neighbour_queries); };
+
+    auto [y, x] = spawn();
+
+    while (true) {
+        if (spawn_region && spawn_region->strayed(y, x)) {
+            std::array<float, 2> position = spawn();
+            y = position[0];
+            x = position[1];
+        }
+
+        if (distance_field) {
+            float jump = std::min({ distance_field->lowerBoundAt(y, x) - 1.0f, y, x, width - y, width - x }) - 0.01f;
+
+            if (jump > 1.0f) {
+                float theta = dist_2pi(random);
+                y += jump * std::sin(theta);
+                x += jump * std::cos(theta);
+                counts.steps++;
+                continue;
+            }
+        }
+
+        if (countedHasNodesAround(graph, y, x, 1.f, counts.neighbour_queries)) {
+            return { y, x };
+        }
+
+        float new_y, new_x;
+        do {
+            float theta = dist_2pi(random);
+            new_y = y + std::sin(theta);
+            new_x = x + std::cos(theta);
+        } while (new_y < 0 || new_y >= width || new_x < 0 || new_x >= width || countedHasNodesAround(graph, new_y, new_x, 0.1, counts.neighbour_queries));
+
+        y = new_y;
+        x = new_x;
+        counts.steps++;
+    }
+}
+
+/**
+ * @brief Walker simulated in a lane of a WalkerGroup, with its random generator and the bits left for directions.
+ */
+struct GroupWalker
+{
+    WalkerRandom random = WalkerRandom(0);
+    std::uint64_t direction_bits = 0;
+    int directions_left = 0; /**< directions (bytes) left in direction_bits */
+    int index = -1; /**< index of the walker in the batch */
+
+    int drawDirection() {
+        if (directions_left == 0) {
+            direction_bits = random();
+            directions_left = 8;
+        }
+
+        int direction = direction_bits & (WalkerGroup::kDirections - 1);
+        direction_bits >>= 8;
+        directions_left--;
+        return direction;
+    }
+};
+
+/**
+ * @brief Same walk as walkUntilStuck() for the walkers [begin, end) of a batch, WalkerGroup::kLanes at a time (a lane
+ * takes the next walker as soon as its walker is stuck). Unit steps use the direction table of WalkerGroup and are
+ * checked against the occupancy grid first: the graph is only searched for walkers in marked cells.
+ * The walk of a walker only depends on its random stream, not on the lanes or the other walkers.
+ *
+ * @param[in] width               square grid width
+ * @param[in] graph               DLA graph (not modified)
+ * @param[in] occupancy           occupancy grid of the graph
+ * @param[in] distance_field      distance field to jump far from the graph, nullptr for unit steps only
+ * @param[in] spawn_region        where to spawn the walkers, nullptr for anywhere on the grid
+ * @param[in] make_random         random generator of the walker with the given index in the batch
+ * @param[in] begin               first walker
+ * @param[in] end                 last walker (excluded)
+ * @param[out] stuck_positions    coordinates where each walker stuck
+ * @param[out] counts             moves and graph queries of each walker
+ */
+template <typename MakeRandom>
+static void walkGroupUntilStuck(int width, const Graph& graph, const OccupancyGrid& occupancy, const DistanceField* distance_field, const SpawnRegion* spawn_region,
+                                MakeRandom make_random, int begin, int end, std::vector<std::array<float, 2>>& stuck_positions, std::vector<WalkerCounts>& counts) {
+    WalkerGroup group;
+    std::array<GroupWalker, WalkerGroup::kLanes> walkers;
+    unsigned live_mask = 0;
+    int next = begin;
+
+    auto spawn = [&](int lane) {
+        std::array<float, 2> position = spawnWalker(width, graph, spawn_region, walkers[lane].random, counts[walkers[lane].index].neighbour_queries);
+        group.y_[lane] = position[0];
+        group.x_[lane] = position[1];
+    };
+
+    auto start = [&](int lane) {
+        live_mask &= ~(1u << lane);
+        if (next == end) {
+            return;
+        }
+
+        walkers[lane] = GroupWalker{ make_random(next), 0, 0, next };
+        counts[next] = WalkerCounts();
+        next++;
+
+        spawn(lane);
+        live_mask |= 1u << lane;
+    };
+
+    for (int lane = 0; lane < WalkerGroup::kLanes; lane++) {
+        start(lane);
+    }
+
+    while (live_mask) {
+        unsigned step_mask = 0;
+
+        for (int lane = 0; lane < WalkerGroup::kLanes; lane++) {
+            if (!(live_mask & (1u << lane))) {
+                continue;
+            }
+
+            GroupWalker& walker = walkers[lane];
+            float& y = group.y_[lane];
+            float& x = group.x_[lane];
+
+            if (spawn_region && spawn_region->strayed(y, x)) {
+                spawn(lane);
+            }
+
+            if (distance_field) {
+                float jump = std::min({ distance_field->lowerBoundAt(y, x) - 1.0f, y, x, width - y, width - x }) - 0.01f;
+
+                if (jump > 1.0f) {
+                    int direction = walker.drawDirection();
+                    y += jump * WalkerGroup::directionY(direction);
+                    x += jump * WalkerGroup::directionX(direction);
+                    counts[walker.index].steps++;
+                    continue;
+                }
+            }
+
+            if (occupancy.isNear(y, x) && countedHasNodesAround(graph, y, x, 1.f, counts[walker.index].neighbour_queries)) {
+                stuck_positions[walker.index] = { y, x };
+                start(lane);
+                continue;
+            }
+
+            group.direction_[lane] = walker.drawDirection();
+            step_mask |= 1u << lane;
+        }
+
+        unsigned moved_mask;
+        unsigned near_mask = group.step(step_mask, occupancy, moved_mask);
+
+        for (int lane = 0; lane < WalkerGroup::kLanes; lane++) {
+            WalkerCounts& walker_counts = counts[walkers[lane].index];
+
+            if (moved_mask & (1u << lane)) {
+                walker_counts.steps++;
+            } else if (near_mask & (1u << lane)) {
+                // candidate stick: the step is only refused if it lands on a node, like walkUntilStuck()
+                float new_y = group.destinationY(lane);
+                float new_x = group.destinationX(lane);
+
+                if (!countedHasNodesAround(graph, new_y, new_x, 0.1, walker_counts.neighbour_queries)) {
+                    group.y_[lane] = new_y;
+                    group.x_[lane] = new_x;
+                    walker_counts.steps++;
+                }
+            }
+        }
+    }
+}
+
 /**
  * @brief Add nodes to the graph until a certain density threshold is reached. Nodes are spawned randomly and
  * move in a random direction continously on the grid until they are close enough to another node.
  * An edge is created between this node and the node that it stuck to. If there are multiple pixels next to it,
  * the edge is created with the node closest to the center of the graph.
  *
+ * With WalkMode::DISTANCE_FIELD_JUMPS, a walker whose distance to the graph is known to be larger than 2 jumps to a
+ * random point of the circle centered on it with radius its distance to the graph minus 1 (and to the grid border).
+ * A random walk leaves such a circle at a uniformly distributed point, so attachment statistics are kept while far
+ * away walkers need orders of magnitude less steps.
+ *
+ * With SpawnMode::AGGREGATE_BAND, walkers start on a band just outside the graph (see SpawnRegion) and start again
+ * from there when they stray too far, instead of starting anywhere on the grid (inside the graph or far from it).
+ *
  * @param[in] width       square grid width
  * @param[in, out] graph  DLA graph
  */
 void DLAGenerator::populateGraph(int width, Graph& graph) {
-    if (graph.nodes_list_.size() <= 1) { // dummy node
+    if (graph.size() <= 1) { // dummy node
         throw std::runtime_error("DLAGenerator: populateGrid: Need at least one node on the graph to populate it");
     }
 
-    float density = static_cast<float>(graph.nodes_list_.size() - 1) / (width * width);
+    if (graph.grid_width_ != width) {
+        graph.setGridWidth(width);
+    }
 
-    while (density < this->density_threshold_) {
-        std::array<float, 2> pixel_coords = getRandom2DPixelCoordinates(width, width);
-        float y = pixel_coords[0];
-        float x = pixel_coords[1];
+    if (aggregation_threads_ > 0) {
+        populateGraphInBatches(width, graph);
+        return;
+    }
+
+    std::unique_ptr<DistanceField> distance_field = nullptr;
+    if (walk_mode_ == WalkMode::DISTANCE_FIELD_JUMPS) {
+        distance_field = std::make_unique<DistanceField>(width, graph);
+    }
+
+    std::unique_ptr<SpawnRegion> spawn_region = nullptr;
+    if (spawn_mode_ == SpawnMode::AGGREGATE_BAND) {
+        // (a resumed generation replays the nodes added at this level before its checkpoint)
+        size_t first_new_label = (generation_ && &generation_->graph == &graph) ? generation_->level_first_label : graph.size();
+        spawn_region = std::make_unique<SpawnRegion>(width, graph_center_y_ * width, graph_center_x_ * width, graph, first_new_label);
+    }
+
+    auto spawn = [&]() -> std::array<float, 2> {
+        std::array<float, 2> pixel_coords = spawn_region ? spawn_region->spawn(rng_) : getRandom2DPixelCoordinates(width, width);
 
         // check if there is already a graph node too close to this position (small radius, here 0.1)
-        while (graph.getNodesAround(y, x, 0.1).size() > 0) {
-            pixel_coords = getRandom2DPixelCoordinates(width, width);
-            y = pixel_coords[0];
-            x = pixel_coords[1];
+        while (countedHasNodesAround(graph, pixel_coords[0], pixel_coords[1], 0.1, neighbour_queries_)) {
+            pixel_coords = spawn_region ? spawn_region->spawn(rng_) : getRandom2DPixelCoordinates(width, width);
         }
 
+        return pixel_coords;
+    };
+
+    auto last_checkpoint = std::chrono::steady_clock::now();
+
+    float density = static_cast<float>(graph.size() - 1) / (width * width);
+
+    while (density < this->density_threshold_) {
+        auto [y, x] = spawn();
+
         while (true) {
+            if (spawn_region && spawn_region->strayed(y, x)) {
+                std::array<float, 2> position = spawn();
+                y = position[0];
+                x = position[1];
+            }
+
+            if (distance_field) {
+                // stay 1 away from the graph (sticking radius) and inside the grid
+                float jump = std::min({ distance_field->lowerBoundAt(y, x) - 1.0f, y, x, width - y, width - x }) - 0.01f;
+
+                if (jump > 1.0f) {
+                    float theta = real_dist_2pi_(rng_);
+                    y += jump * std::sin(theta);
+                    x += jump * std::cos(theta);
+                    walk_steps_++;
+                    continue;
+                }
+            }
+
             // check if the pixel is next to another pixel (1 radius)
-            std::vector<int> labels_around = graph.getNodesAround(y, x, 1.f);
+            std::vector<int> labels_around = countedGetNodesAround(graph, y, x, 1.f, neighbour_queries_);
 
             if (labels_around.size() > 0) {
                 // add it to the graph and continue the main loop
                 // (if multiple pixels next to it, add edge to the one closest to the center of the grid)
 
-                int node_label = graph.nodes_list_.size();
-                graph.nodes_list_.push_back(std::make_shared<Node>(node_label, y, x, -1.0f));
-                graph.adjacency_list_.push_back({});
+                int node_label = graph.addNode(y, x);
 
                 // std::cout << "Node: " << node_label << " at (" << y << ", " << x << ")" << std::endl;
 
@@ -129,8 +710,8 @@ void DLAGenerator::populateGraph(int width, Graph& graph) {
                 float min_distance_to_center = std::numeric_limits<float>::max();
 
                 for (int label : labels_around) {
-                    float node_y = graph.nodes_list_[label]->y_;
-                    float node_x = graph.nodes_list_[label]->x_;
+                    float node_y = graph.y_[label];
+                    float node_x = graph.x_[label];
                     
                     float distance_to_center = utils::euclidianDistance(node_y, node_x, graph_center_y_ * width, graph_center_x_ * width);
 
@@ -140,8 +721,15 @@ void DLAGenerator::populateGraph(int width, Graph& graph) {
                     }
                 }
 
-                graph.adjacency_list_[node_label].push_back(label_closest_to_center);
-                graph.adjacency_list_[label_closest_to_center].push_back(node_label);
+                graph.attachLeaf(node_label, label_closest_to_center);
+
+                if (distance_field) {
+                    distance_field->addNode(y, x);
+                }
+
+                if (spawn_region) {
+                    spawn_region->addNode(y, x);
+                }
 
                 break;
             }
@@ -156,7 +744,7 @@ void DLAGenerator::populateGraph(int width, Graph& graph) {
             float new_y = y + r * std::sin(theta);
             float new_x = x + r * std::cos(theta);
 
-            while (new_y < 0 || new_y >= width || new_x < 0 || new_x >= width || graph.getNodesAround(new_y, new_x, 0.1).size() > 0) {
+            while (new_y < 0 || new_y >= width || new_x < 0 || new_x >= width || countedHasNodesAround(graph, new_y, new_x, 0.1, neighbour_queries_)) {
                 theta = real_dist_2pi_(rng_);
                 // r = real_dist_1_(rng_);
 
@@ -167,20 +755,156 @@ void DLAGenerator::populateGraph(int width, Graph& graph) {
 
             y = new_y;
             x = new_x;
+            walk_steps_++;
         }
 
-        density = static_cast<float>(graph.nodes_list_.size() - 1) / (width * width);
+        density = static_cast<float>(graph.size() - 1) / (width * width);
+
+        checkpointIfDue(graph, last_checkpoint);
     }
 }
 
-bool edgeAlreadyProcessed(const std::vector<std::array<int, 2>>& processed_edges, int node1_label, int node2_label) {
-    for (const auto& edge : processed_edges) {
-        if ((edge[0] == node1_label && edge[1] == node2_label) || (edge[0] == node2_label && edge[1] == node1_label)) {
-            return true;
+/**
+ * @brief Pool of aggregation_threads_ threads for populateGraphInBatches(), created on its first call and reused by
+ * the following levels (created again if aggregation_threads_ has changed).
+ *
+ * @return the pool of the generator
+ */
+ThreadPool& DLAGenerator::aggregationPool() {
+    if (!aggregation_pool_ || aggregation_pool_->size() != aggregation_threads_) {
+        aggregation_pool_ = std::make_shared<ThreadPool>(aggregation_threads_);
+    }
+    return *aggregation_pool_;
+}
+
+/**
+ * @brief Parallel version of populateGraph(), used when aggregation_threads_ > 0.
+ * Walkers are simulated in batches against the graph as it was at the start of the batch, then attached in walker
+ * order. A walker that lands on a node attached earlier in the same batch is dropped. Each walker has its own random
+ * stream keyed by its index, so the result only depends on the seed, not on the number of threads.
+ * Batches grow with the graph (1/64 of its size) to keep walkers of a batch from interfering too much.
+ *
+ * With simd_walkers_, the walkers are moved by groups of WalkerGroup::kLanes (see walkGroupUntilStuck()), with
+ * directions quantized to WalkerGroup::kDirections, so the graph differs from the one of scalar walkers.
+ *
+ * @param[in] width       square grid width
+ * @param[in, out] graph  DLA graph, with at least one node and a bucket grid of the given width
+ */
+void DLAGenerator::populateGraphInBatches(int width, Graph& graph) {
+    std::unique_ptr<DistanceField> distance_field = nullptr;
+    if (walk_mode_ == WalkMode::DISTANCE_FIELD_JUMPS) {
+        distance_field = std::make_unique<DistanceField>(width, graph);
+    }
+
+    std::unique_ptr<SpawnRegion> spawn_region = nullptr;
+    if (spawn_mode_ == SpawnMode::AGGREGATE_BAND) {
+        // (a resumed generation replays the nodes added at this level before its checkpoint)
+        size_t first_new_label = (generation_ && &generation_->graph == &graph) ? generation_->level_first_label : graph.size();
+        spawn_region = std::make_unique<SpawnRegion>(width, graph_center_y_ * width, graph_center_x_ * width, graph, first_new_label);
+    }
+
+    std::unique_ptr<OccupancyGrid> occupancy = nullptr;
+    if (simd_walkers_) {
+        occupancy = std::make_unique<OccupancyGrid>(width);
+        for (size_t i = 1; i < graph.size(); i++) {
+            occupancy->markNode(graph.y_[i], graph.x_[i]);
         }
     }
 
-    return false;
+    ThreadPool& pool = aggregationPool();
+
+    // state of the running generateUpscaledHeightmap() (if the graph is its own), to resume the walker streams
+    GenerationState* generation = (generation_ && &generation_->graph == &graph) ? generation_ : nullptr;
+
+    // walker streams of this call, drawn from the generator to stay reproducible with a fixed seed
+    std::uint64_t stream_key;
+    std::uint64_t walker_index;
+    if (generation && generation->walker_index > 0) {
+        stream_key = generation->stream_key;
+        walker_index = generation->walker_index;
+    } else {
+        stream_key = WalkerRandom::mix(rng_());
+        walker_index = 0;
+    }
+
+    auto last_checkpoint = std::chrono::steady_clock::now();
+
+    const size_t target_size = static_cast<size_t>(std::ceil(density_threshold_ * width * width)) + 1; // dummy node
+
+    while (static_cast<float>(graph.size() - 1) / (width * width) < density_threshold_) {
+        int batch_size = std::clamp(static_cast<int>(graph.size() / 64), 1, 4096);
+        batch_size = std::min(batch_size, static_cast<int>(target_size - graph.size()) + 1);
+
+        std::vector<std::array<float, 2>> stuck_positions(batch_size);
+        std::vector<WalkerCounts> counts(batch_size);
+
+        if (occupancy) {
+            auto make_random = [&](int i) { return WalkerRandom(stream_key ^ WalkerRandom::mix(walker_index + i)); };
+
+            pool.parallel_for(0, batch_size, WalkerGroup::kLanes, [&](int begin, int end) {
+                walkGroupUntilStuck(width, graph, *occupancy, distance_field.get(), spawn_region.get(), make_random, begin, end, stuck_positions, counts);
+            });
+        } else {
+            pool.parallel_for(0, batch_size, 1, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    WalkerRandom random(stream_key ^ WalkerRandom::mix(walker_index + i));
+                    stuck_positions[i] = walkUntilStuck(width, graph, distance_field.get(), spawn_region.get(), random, counts[i]);
+                }
+            });
+        }
+        walker_index += batch_size;
+
+        if (generation) {
+            generation->stream_key = stream_key;
+            generation->walker_index = walker_index;
+        }
+
+        for (int i = 0; i < batch_size; i++) {
+            walk_steps_ += counts[i].steps;
+            neighbour_queries_ += counts[i].neighbour_queries;
+
+            if (static_cast<float>(graph.size() - 1) / (width * width) >= density_threshold_) {
+                break;
+            }
+
+            auto [y, x] = stuck_positions[i];
+            if (countedHasNodesAround(graph, y, x, 0.1, neighbour_queries_)) {
+                continue;
+            }
+
+            // (nodes attached earlier in this batch included, as if the walkers had run one after the other)
+            std::vector<int> labels_around = countedGetNodesAround(graph, y, x, 1.f, neighbour_queries_);
+
+            int label_closest_to_center = -1;
+            float min_distance_to_center = std::numeric_limits<float>::max();
+
+            for (int label : labels_around) {
+                float distance_to_center = utils::euclidianDistance(graph.y_[label], graph.x_[label], graph_center_y_ * width, graph_center_x_ * width);
+
+                if (distance_to_center < min_distance_to_center) {
+                    label_closest_to_center = label;
+                    min_distance_to_center = distance_to_center;
+                }
+            }
+
+            int node_label = graph.addNode(y, x);
+            graph.attachLeaf(node_label, label_closest_to_center);
+
+            if (distance_field) {
+                distance_field->addNode(y, x);
+            }
+
+            if (spawn_region) {
+                spawn_region->addNode(y, x);
+            }
+
+            if (occupancy) {
+                occupancy->markNode(y, x);
+            }
+        }
+
+        checkpointIfDue(graph, last_checkpoint);
+    }
 }
 
 /**
@@ -190,36 +914,50 @@ bool edgeAlreadyProcessed(const std::vector<std::array<int, 2>>& processed_edges
  * Then, subdivide the edges in 2 smaller edges. Also add random offset to the intermediate vertex
  * to ensure the result doesnt contain lots of straight lines
  *
+ * Linear in the number of edges: each edge is subdivided once, from its node with the smallest label, then the low
+ * resolution adjacency lists are replaced by the subdivided edges.
+ *
  * @param[in, out] graph  DLA graph
  */
 void DLAGenerator::upscaleGraph(Graph& graph) {
     // Update position of graph nodes to match the new resolution (y and x coordinates of the nodes)
 
-    for (size_t i = 1; i < graph.nodes_list_.size(); i++) {
-        graph.nodes_list_[i]->y_ *= 2;
-        graph.nodes_list_[i]->x_ *= 2;
+    for (size_t i = 1; i < graph.size(); i++) {
+        graph.y_[i] *= 2;
+        graph.x_[i] *= 2;
+    }
+
+    if (graph.grid_width_ > 0) {
+        graph.setGridWidth(graph.grid_width_ * 2);
     }
 
-    std::vector<std::array<int, 2>> processed_edges = {};
     std::vector<std::array<int, 2>> edges_to_add = {};
 
-    size_t low_res_graph_size = graph.nodes_list_.size();
+    size_t low_res_graph_size = graph.size();
 
-    for (size_t i = 1; i < low_res_graph_size; i++) {
-        size_t node_degree = graph.adjacency_list_[i].size();
-
-        for (size_t j = 0; j < node_degree; j++) {
-            std::shared_ptr<Node> node1 = graph.nodes_list_[i];
-            std::shared_ptr<Node> node2 = graph.nodes_list_[graph.adjacency_list_[i][j]];
+    // subdividing every edge makes every downstream path 2 times longer (minus the leaf): tree heights go from h to
+    // 2h - 1, and a middle node is 1 higher than its child
+    bool tree_heights_valid = graph.tree_heights_valid_;
+    if (tree_heights_valid) {
+        for (size_t i = 1; i < low_res_graph_size; i++) {
+            graph.tree_height_[i] = 2 * graph.tree_height_[i] - 1;
+        }
+    }
 
-            if (edgeAlreadyProcessed(processed_edges, node1->label_, node2->label_)) {
+    for (size_t i = 1; i < low_res_graph_size; i++) {
+        for (int neighbour_label : graph.neighbours(i)) {
+            // each (undirected) edge is in the lists of both its nodes, process it from the one with the smallest label
+            if (neighbour_label < static_cast<int>(i)) {
                 continue;
             }
 
+            Node node1 = graph.node(i);
+            Node node2 = graph.node(neighbour_label);
+
             // Create a new node in the middle of the edge
 
-            float middle_y = (node1->y_ + node2->y_) / 2;
-            float middle_x = (node1->x_ + node2->x_) / 2;
+            float middle_y = (node1.y_ + node2.y_) / 2;
+            float middle_x = (node1.x_ + node2.x_) / 2;
 
             // Add random offset to intermediate points and round coordinates [-0.25, 0.25)
 
@@ -228,23 +966,34 @@ void DLAGenerator::upscaleGraph(Graph& graph) {
             middle_y += offset_y;
             middle_x += offset_x;
 
+            // the offset must not move nodes of the border out of the grid
+            if (graph.grid_width_ > 0) {
+                float max_coordinate = std::nextafter(static_cast<float>(graph.grid_width_), 0.0f);
+                middle_y = std::clamp(middle_y, 0.0f, max_coordinate);
+                middle_x = std::clamp(middle_x, 0.0f, max_coordinate);
+            }
+
             // Add the middle node to the graph and the grid
 
-            int middle_node_label = graph.nodes_list_.size();
-            graph.nodes_list_.push_back(std::make_shared<Node>(middle_node_label, middle_y, middle_x, -1.0f));
-            graph.adjacency_list_.push_back({});
+            int middle_node_label = graph.addNode(middle_y, middle_x);
 
-            edges_to_add.push_back({ node1->label_, middle_node_label });
-            edges_to_add.push_back({ middle_node_label, node2->label_ });
+            edges_to_add.push_back({ node1.label_, middle_node_label });
+            edges_to_add.push_back({ middle_node_label, node2.label_ });
 
-            // Store the processed edge to avoid processing it again (undirected graph)
+            if (tree_heights_valid) {
+                int parent_label = (graph.parent_[node2.label_] == node1.label_) ? node1.label_ : node2.label_;
+                int child_label = (parent_label == node1.label_) ? node2.label_ : node1.label_;
 
-            processed_edges.push_back({ node1->label_, node2->label_ });
+                graph.parent_[middle_node_label] = parent_label;
+                graph.parent_[child_label] = middle_node_label;
+                graph.tree_height_[middle_node_label] = graph.tree_height_[child_label] + 1;
+            }
         }
     }
 
-    graph.removeEdges(processed_edges);
-    graph.addEdges(edges_to_add);
+    // every edge of the low resolution graph has been subdivided
+    graph.replaceEdges(edges_to_add);
+    graph.tree_heights_valid_ = tree_heights_valid;
 }
 
 /**
@@ -259,17 +1008,23 @@ void convolution(Heightmap& grid, const std::vector<std::vector<float>>& kernel)
     int kernel_size = kernel.size();
     int kernel_center = std::floor(kernel_size / 2);
 
+    // (in place: pixels above and on the left are already convolved when they are read)
     for (int y = kernel_center; y < grid.height_ - kernel_center; y++) {
+        std::span<float> row = grid.row(y);
+
         for (int x = kernel_center; x < grid.width_ - kernel_center; x++) {
             float new_value = 0.0f;
 
             for (int i = 0; i < kernel_size; i++) {
+                std::span<const float> source = grid.row(y + i - kernel_center).subspan(x - kernel_center, kernel_size);
+                const std::vector<float>& weights = kernel[i];
+
                 for (int j = 0; j < kernel_size; j++) {
-                    new_value += kernel[i][j] * grid.at(y + i - kernel_center, x + j - kernel_center);
+                    new_value += weights[j] * source[j];
                 }
             }
 
-            grid.set(y, x, new_value);
+            row[x] = new_value;
         }
     }
 }
@@ -288,27 +1043,25 @@ Heightmap DLAGenerator::upscaleBlurryGrid(const Heightmap& low_res_blurry_grid)
     Heightmap high_res_grid = Heightmap(low_res_blurry_grid.width_ * 2, low_res_blurry_grid.height_ * 2);
 
     // Use linear interpolation on small resolution grid to get a 2x higher resolution grid
+    // (pixel y of the high resolution grid is between the low resolution rows floor(y / 2) and ceil(y / 2), the same
+    // row for even y, and the last row is repeated after the border)
     for (int y = 0; y < high_res_grid.height_; y++) {
+        std::span<const float> top = low_res_blurry_grid.row(y / 2);
+        std::span<const float> bottom = low_res_blurry_grid.row(std::min((y + 1) / 2, low_res_blurry_grid.height_ - 1));
+        std::span<float> row = high_res_grid.row(y);
+
         for (int x = 0; x < high_res_grid.width_; x++) {
-            float low_res_y = static_cast<float>(y) / 2;
-            float low_res_x = static_cast<float>(x) / 2;
-
-            int y_ceil_pos = (std::ceil(low_res_y) < low_res_blurry_grid.height_) ? std::ceil(low_res_y) : low_res_blurry_grid.height_ - 1;
-            int x_ceil_pos = (std::ceil(low_res_x) < low_res_blurry_grid.width_) ? std::ceil(low_res_x) : low_res_blurry_grid.width_ - 1;
-
-            if (low_res_y == std::floor(low_res_y) && low_res_x == std::floor(low_res_x)) {
-                high_res_grid.set(y, x, low_res_blurry_grid.at(low_res_y, low_res_x));
-            } else if (low_res_y == std::floor(low_res_y)) {
-                high_res_grid.set(y, x, (low_res_blurry_grid.at(low_res_y, std::floor(low_res_x)) + low_res_blurry_grid.at(low_res_y, x_ceil_pos)) / 2);
-            } else if (low_res_x == std::floor(low_res_x)) {
-                high_res_grid.set(y, x, (low_res_blurry_grid.at(std::floor(low_res_y), low_res_x) + low_res_blurry_grid.at(y_ceil_pos, low_res_x)) / 2);
+            int x_floor_pos = x / 2;
+            int x_ceil_pos = std::min((x + 1) / 2, low_res_blurry_grid.width_ - 1);
+
+            if (y % 2 == 0 && x % 2 == 0) {
+                row[x] = top[x_floor_pos];
+            } else if (y % 2 == 0) {
+                row[x] = (top[x_floor_pos] + top[x_ceil_pos]) / 2;
+            } else if (x % 2 == 0) {
+                row[x] = (top[x_floor_pos] + bottom[x_floor_pos]) / 2;
             } else {
-                float top_left = low_res_blurry_grid.at(std::floor(low_res_y), std::floor(low_res_x));
-                float top_right = low_res_blurry_grid.at(std::floor(low_res_y), x_ceil_pos);
-                float bottom_left = low_res_blurry_grid.at(y_ceil_pos, std::floor(low_res_x));
-                float bottom_right = low_res_blurry_grid.at(y_ceil_pos, x_ceil_pos);
-
-                high_res_grid.set(y, x, (top_left + top_right + bottom_left + bottom_right) / 4);
+                row[x] = (top[x_floor_pos] + top[x_ceil_pos] + bottom[x_floor_pos] + bottom[x_ceil_pos]) / 4;
             }
         }
     }
@@ -334,71 +1087,6 @@ Heightmap DLAGenerator::upscaleBlurryGrid(const Heightmap& low_res_blurry_grid)
     return high_res_grid;
 }
 
-/**
- * @brief Get the depth levels of the graph (BFS traversal)
- *
- * @param[in] graph  graph representation of the pixels of the grid
- *
- * @return vector of sets of node labels representing the depth levels of the graph,
- * ordered from root to deepest level (left to right in the vector)
- */
-std::vector<std::set<int>> getGraphDepthLevels(const Graph& graph) {
-    std::vector<std::set<int>> levels;
-
-    std::vector<bool> visited_nodes(graph.nodes_list_.size(), false);
-    std::queue<int> nodes_queue;
-
-    visited_nodes[0] = true; // dummy node
-    visited_nodes[1] = true; // first node
-
-    nodes_queue.push(1); // first node
-    nodes_queue.push(-1); // level separator
-
-    std::set<int> current_level;
-
-    while (!nodes_queue.empty()) {
-        int current_node_label = nodes_queue.front();
-        if (current_node_label == -1) {
-            nodes_queue.pop();
-            if (!nodes_queue.empty()) {
-                nodes_queue.push(-1);
-            }
-            levels.push_back(current_level);
-            current_level.clear();
-            continue;
-        }
-        nodes_queue.pop();
-
-        current_level.insert(current_node_label);
-
-        for (int adjacent_label : graph.adjacency_list_[current_node_label]) {
-            if (!visited_nodes[adjacent_label]) {
-                visited_nodes[adjacent_label] = true;
-                nodes_queue.push(adjacent_label);
-            }
-        }
-    }
-
-    return levels;
-}
-
-void tmpExportLevels(const std::vector<std::set<int>>& levels) {
-    std::ofstream file("../images/DLA/DLA_levels.txt");
-    if (!file.is_open()) {
-        throw std::runtime_error("DLAGenerator: tmpExportLevels: Could not open file ../images/DLA/DLA_levels.txt");
-    }
-
-    for (size_t i = 0; i < levels.size(); i++) {
-        file << "Level " << i << ": ";
-        for (int label : levels[i]) {
-            file << label << " ";
-        }
-        file << std::endl;
-    }
-
-    file.close();
-}
-
 /**
  * @brief Process graph height values to assign higher values to pixels the nearer to the center they are on the blurry grid:
  * 
@@ -406,64 +1094,25 @@ void tmpExportLevels(const std::vector<std::set<int>>& levels) {
  * 
  * Assign outermost pixels value 1
  * Assign each pixel the maximum value of pixels that are downstream from it + 1
+ * (see Graph::computeTreeHeights(), only run once, later levels update these values incrementally)
  * Use smooth falloff formula: 1 - 1 / (1 + h), to assign a height value (float) from the value (int) to the pixel
  *
  * @param[in, out] graph  graph representation of the pixels of the (crisp) grid
  */
 void DLAGenerator::setGraphHeightValues(Graph& graph) {
-    for (size_t i = 1; i < graph.nodes_list_.size(); i++) {
-        graph.nodes_list_[i]->height_ = -1.0f;
-    }
-
-    std::vector<std::set<int>> levels = getGraphDepthLevels(graph);
-    // tmpExportLevels(levels);
-
-    if (levels.size() == 0) {
-        throw std::runtime_error("DLAGenerator: setGraphHeightValues: No levels found in the graph");
+    // heights are kept up to date by populateGraph() and upscaleGraph() once computed
+    if (!graph.tree_heights_valid_) {
+        graph.computeTreeHeights();
     }
 
-    for (int label : levels[levels.size() - 1]) {
-        graph.nodes_list_[label]->height_ = 1.0f;
-    }
-
-    for (int i = levels.size() - 2; i >= 0; i--) {
-        for (int label : levels[i]) {
-            if (graph.adjacency_list_[label].size() == 1) {
-                graph.nodes_list_[label]->height_ = 1.0f;
-            } else {
-                float max_height = -1.0f;
-
-                for (int adjacent_label : graph.adjacency_list_[label]) {
-                    if (levels[i + 1].contains(adjacent_label)) {
-                        max_height = std::max(max_height, graph.nodes_list_[adjacent_label]->height_);
-                    }
-                }
-
-                if (max_height == -1.0f) {
-                    throw std::runtime_error("DLAGenerator: setGraphHeightValues: Could not find a downstream node for node " + std::to_string(label));
-                }
-
-                graph.nodes_list_[label]->height_ = max_height + 1.0f;
-            }
-        }
-    }
-
-    for (size_t i = 1; i < graph.nodes_list_.size(); i++) {
-        if (graph.nodes_list_[i]->height_ == -1.0f) {
-            throw std::runtime_error("DLAGenerator: setGraphHeightValues: Some nodes have not been assigned a height value");
-        }
-    }
-
-    // graph.exportNodesHeight("../images/DLA/DLA_nodes_height.txt");
-
     // smooth fall-off formula: 1 - 1 / (1 + h)
     auto smooth_falloff = [](int h) -> float {
         return 1.0f - 1.0f / (1.0f + static_cast<float>(h));
     };
 
     // for every node we convert the "integer" height value to the real height value using the smooth falloff formula
-    for (size_t i = 1; i < graph.nodes_list_.size(); i++) {
-        graph.nodes_list_[i]->height_ = smooth_falloff(graph.nodes_list_[i]->height_);
+    for (size_t i = 1; i < graph.size(); i++) {
+        graph.height_[i] = smooth_falloff(graph.tree_height_[i]);
     }
 
     // graph.exportNodesHeight("../images/DLA/DLA_nodes_height.txt");
@@ -479,11 +1128,11 @@ void DLAGenerator::setGraphHeightValues(Graph& graph) {
  * @param[in] graph             graph representation of the pixels of the (crisp) grid that hold the height values
  */
 void addHeightToBlurryGrid(Heightmap& blurry_grid, const Graph& graph) {
-    for (size_t i = 1; i < graph.nodes_list_.size(); i++) {
-        float graph_height = graph.nodes_list_[i]->height_;
-        float blurry_grid_height = blurry_grid.at(graph.nodes_list_[i]->y_, graph.nodes_list_[i]->x_);
+    for (size_t i = 1; i < graph.size(); i++) {
+        float graph_height = graph.height_[i];
+        float blurry_grid_height = blurry_grid.at(graph.y_[i], graph.x_[i]);
 
-        blurry_grid.set(graph.nodes_list_[i]->y_, graph.nodes_list_[i]->x_, blurry_grid_height + graph_height); // FIXME check if it is correct to add
+        blurry_grid.set(graph.y_[i], graph.x_[i], blurry_grid_height + graph_height); // FIXME check if it is correct to add
     }
 }
 
@@ -499,13 +1148,13 @@ void addHeightToBlurryGrid(Heightmap& blurry_grid, const Graph& graph) {
 Heightmap DLAGenerator::graphToHeightmap(int width, const Graph& graph) {
     Heightmap heightmap = Heightmap(width, width);
 
-    for (size_t i = 1; i < graph.nodes_list_.size(); i++) {
-        float height = graph.nodes_list_[i]->height_;
+    for (size_t i = 1; i < graph.size(); i++) {
+        float height = graph.height_[i];
 
-        int y_int = static_cast<int>(graph.nodes_list_[i]->y_);
-        float y_decimal = graph.nodes_list_[i]->y_ - y_int;
-        int x_int = static_cast<int>(graph.nodes_list_[i]->x_);
-        float x_decimal = graph.nodes_list_[i]->x_ - x_int;
+        int y_int = static_cast<int>(graph.y_[i]);
+        float y_decimal = graph.y_[i] - y_int;
+        int x_int = static_cast<int>(graph.x_[i]);
+        float x_decimal = graph.x_[i] - x_int;
 
         float y_weight = 0.5f - ((y_decimal < 0.5f) ? y_decimal : 1.0f - y_decimal);
         float x_weight = 0.5f - ((x_decimal < 0.5f) ? x_decimal : 1.0f - x_decimal);
@@ -576,63 +1225,291 @@ Heightmap DLAGenerator::graphToHeightmap(int width, const Graph& graph) {
  * @return high resolution square heightmap representing a terrain (mountains)
  */
 Heightmap DLAGenerator::generateUpscaledHeightmap(int width) {
-    int power_of_two = 3;
-    int base_width = 8; // 2^3
-
-    Graph graph;
+    GenerationState state;
+    state.width = width;
+    state.level_width = 8; // 2^3
 
     // Add first real node to the graph 
 
-    std::array<float, 2> pixel_coords = { graph_center_y_ * base_width, graph_center_x_ * base_width };
-    int node_label = graph.nodes_list_.size(); // should be 1 (first actual node)
-    graph.nodes_list_.push_back(std::make_shared<Node>(node_label, pixel_coords[0], pixel_coords[1], -1.0f));
-    graph.adjacency_list_.push_back({});
+    std::array<float, 2> pixel_coords = { graph_center_y_ * state.level_width, graph_center_x_ * state.level_width };
+    state.graph.addNode(pixel_coords[0], pixel_coords[1]); // label 1 (first actual node)
+    state.level_first_label = state.graph.size();
 
-    populateGraph(base_width, graph);
-    setGraphHeightValues(graph);
+    return runGeneration(state);
+}
 
-    // Main loop
+/**
+ * @brief Finish a generateUpscaledHeightmap() run from one of its checkpoints, with the same result as an
+ * uninterrupted run. The generator parameters (density, graph center, walk and spawn modes) are restored from the checkpoint.
+ *
+ * @param[in] checkpoint_filename  checkpoint written by a previous run (see checkpoint_filename_)
+ *
+ * @return square heightmap representing some terrain (mountains)
+ */
+Heightmap DLAGenerator::resumeUpscaledHeightmap(const std::string& checkpoint_filename) {
+    GenerationState state = readCheckpoint(checkpoint_filename);
+    return runGeneration(state);
+}
 
-    Heightmap low_res_blurry_grid = graphToHeightmap(base_width, graph);
-    Heightmap high_res_blurry_grid = low_res_blurry_grid;
+/**
+ * @param[in, out] start  start of the phase, set to now
+ *
+ * @return seconds since start
+ */
+static double lapSeconds(std::chrono::steady_clock::time_point& start) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - start;
+    start = now;
+    return elapsed.count();
+}
 
-    while (std::pow(2, power_of_two) < width) {
+/**
+ * @brief Main loop of generateUpscaledHeightmap(), starting from any state (level populated or not).
+ * The state is saved to checkpoint_filename_ (if any) after each level, and the level statistics to level_stats_.
+ *
+ * @param[in, out] state  generation state
+ *
+ * @return square heightmap representing some terrain (mountains)
+ */
+Heightmap DLAGenerator::runGeneration(GenerationState& state) {
+    generation_ = &state;
+    Graph& graph = state.graph;
+    level_stats_.clear();
+
+    while (true) {
+        if (level_start_hook_) {
+            level_start_hook_();
+        }
         auto start = std::chrono::high_resolution_clock::now();
+        auto phase_start = std::chrono::steady_clock::now();
 
-        // graph
+        LevelStats stats;
+        long long level_first_walk_steps = walk_steps_;
+        long long level_first_neighbour_queries = neighbour_queries_;
+
+        if (state.level_done) {
+            if (state.level_width >= state.width) {
+                break;
+            }
+
+            // graph
+
+            upscaleGraph(graph);
+            state.level_width *= 2;
+            state.level_done = false;
+            state.level_first_label = graph.size();
+            stats.upscale_graph_seconds = lapSeconds(phase_start);
+
+            Heightmap graph_heightmap = graphToHeightmap(state.level_width, graph); // useful for visualization
+            stats.graph_to_heightmap_seconds = lapSeconds(phase_start);
+        }
+
+        populateGraph(state.level_width, graph);
+        stats.populate_seconds = lapSeconds(phase_start);
 
-        upscaleGraph(graph);
-        Heightmap graph_heightmap = graphToHeightmap(std::pow(2, power_of_two + 1), graph); // useful for visualization
-        populateGraph(std::pow(2, power_of_two + 1), graph);
         setGraphHeightValues(graph);
+        stats.height_values_seconds = lapSeconds(phase_start);
+
+        bool base_level = state.blurry_grid.width_ == 0;
+        if (base_level) {
+            // base level
+            state.blurry_grid = graphToHeightmap(state.level_width, graph);
+            stats.graph_to_heightmap_seconds += lapSeconds(phase_start);
+        } else {
+            // blurry grid
 
-        // blurry grid
+            Heightmap high_res_blurry_grid = upscaleBlurryGrid(state.blurry_grid);
+            addHeightToBlurryGrid(high_res_blurry_grid, graph);
+            stats.upscale_blurry_grid_seconds = lapSeconds(phase_start);
 
-        high_res_blurry_grid = upscaleBlurryGrid(low_res_blurry_grid);
-        addHeightToBlurryGrid(high_res_blurry_grid, graph);
+            state.blurry_grid = high_res_blurry_grid;
 
-        // save heightmap for each iteration
-        high_res_blurry_grid.writeToFile("../images/DLA/DLA_upscaled_heightmap_" + std::to_string(power_of_two + 1) + ".hmap");
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> elapsed = end - start;
+            std::cout << "Upscaled heightmap for size " << state.level_width << ": " << elapsed.count() << " seconds" << std::endl;
+        }
 
-        // loop management
+        state.level_done = true;
+        state.stream_key = 0;
+        state.walker_index = 0;
 
-        low_res_blurry_grid = high_res_blurry_grid;
-        power_of_two++;
+        if (!checkpoint_filename_.empty()) {
+            writeCheckpoint(state);
+        }
+        stats.output_seconds = lapSeconds(phase_start);
+
+        stats.width = state.level_width;
+        stats.nodes = graph.size();
+        stats.walk_steps = walk_steps_ - level_first_walk_steps;
+        stats.neighbour_queries = neighbour_queries_ - level_first_neighbour_queries;
+        if (level_end_hook_) {
+            level_end_hook_(stats);
+        }
+        level_stats_.push_back(stats);
 
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = end - start;
-        std::cout << "Upscaled heightmap for size " << std::pow(2, power_of_two) << ": " << elapsed.count() << " seconds" << std::endl;
+        // save heightmap for each iteration (after the statistics of the level)
+        if (debug_files_ && !base_level) {
+            state.blurry_grid.writeToFile("../images/DLA/DLA_upscaled_heightmap_" + std::to_string(static_cast<int>(std::log2(state.level_width))) + ".hmap");
+        }
     }
-    
+
+    generation_ = nullptr;
+
     // TODO DELETE only for debug
-    std::cout << graph.nodes_list_.size() << " nodes in the graph" << std::endl; // + 1 because of the dummy node
-    std::cout << graph.adjacency_list_.size() << " adjacency lists" << std::endl; // + 1 because of the dummy node
-    float density = static_cast<float>(graph.nodes_list_.size() - 1) / (std::pow(2, power_of_two) * std::pow(2, power_of_two));
+    std::cout << graph.size() << " nodes in the graph" << std::endl; // + 1 because of the dummy node
+    std::cout << graph.degree_.size() << " adjacency lists" << std::endl; // + 1 because of the dummy node
+    float density = static_cast<float>(graph.size() - 1) / (state.level_width * state.level_width);
     std::cout << "Density: " << density << std::endl;
-    graph.exportToDot("../images/DLA/DLA_upscaled_graph.dot");
+    if (debug_files_) {
+        graph.exportToDot("../images/DLA/DLA_upscaled_graph.dot");
+    }
     // TODO DELETE END
 
-    return high_res_blurry_grid;
+    return state.blurry_grid;
+}
+
+/**
+ * @brief Save a checkpoint from populateGraph() if checkpoint_interval_ seconds went by since the last one.
+ * Only graphs of a running generateUpscaledHeightmap() are saved.
+ *
+ * @param[in] graph                 graph being populated, between two walkers (or batches of walkers)
+ * @param[in, out] last_checkpoint  time of the last checkpoint
+ */
+void DLAGenerator::checkpointIfDue(const Graph& graph, std::chrono::steady_clock::time_point& last_checkpoint) {
+    if (checkpoint_filename_.empty() || checkpoint_interval_ <= 0.0 || !generation_ || &generation_->graph != &graph) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval_) {
+        writeCheckpoint(*generation_);
+        last_checkpoint = now;
+    }
+}
+
+/**
+ * @brief Save the generation state and the generator (parameters and random engine) to checkpoint_filename_.
+ * The file is written next to it first and renamed, so a crash while writing keeps the previous checkpoint.
+ *
+ * Format (machine byte order): "DLACKPT" + version byte, generator parameters and counters, random engine state
+ * (text, prefixed by its length), level, graph (see Graph::writeBinary()), blurry grid (size and raw floats).
+ *
+ * @param[in] state  generation state
+ */
+void DLAGenerator::writeCheckpoint(const GenerationState& state) {
+    const std::string tmp_filename = checkpoint_filename_ + ".tmp";
+    std::ofstream file(tmp_filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("DLAGenerator: writeCheckpoint: Could not open file " + tmp_filename);
+    }
+
+    file.write(kCheckpointMagic, sizeof(kCheckpointMagic));
+
+    utils::writeBinary(file, density_threshold_);
+    utils::writeBinary(file, graph_center_y_);
+    utils::writeBinary(file, graph_center_x_);
+    utils::writeBinary<std::int32_t>(file, static_cast<std::int32_t>(walk_mode_));
+    utils::writeBinary<std::int32_t>(file, static_cast<std::int32_t>(spawn_mode_));
+    utils::writeBinary<std::uint8_t>(file, aggregation_threads_ == 0 ? 0 : (simd_walkers_ ? 2 : 1));
+    utils::writeBinary<std::int64_t>(file, walk_steps_);
+
+    std::ostringstream rng_state;
+    rng_state << rng_;
+    utils::writeBinary<std::uint32_t>(file, rng_state.str().size());
+    file.write(rng_state.str().data(), rng_state.str().size());
+
+    utils::writeBinary<std::int32_t>(file, state.width);
+    utils::writeBinary<std::int32_t>(file, state.level_width);
+    utils::writeBinary<std::uint8_t>(file, state.level_done);
+    utils::writeBinary(file, state.stream_key);
+    utils::writeBinary(file, state.walker_index);
+    utils::writeBinary(file, state.level_first_label);
+
+    state.graph.writeBinary(file);
+
+    utils::writeBinary<std::int32_t>(file, state.blurry_grid.width_);
+    utils::writeBinary<std::int32_t>(file, state.blurry_grid.height_);
+    for (int y = 0; y < state.blurry_grid.height_; y++) {
+        std::span<const float> row = state.blurry_grid.row(y);
+        file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+
+    file.close();
+    if (!file) {
+        throw std::runtime_error("DLAGenerator: writeCheckpoint: Could not write file " + tmp_filename);
+    }
+
+    if (std::rename(tmp_filename.c_str(), checkpoint_filename_.c_str()) != 0) {
+        throw std::runtime_error("DLAGenerator: writeCheckpoint: Could not rename " + tmp_filename + " to " + checkpoint_filename_);
+    }
+}
+
+/**
+ * @brief Read a checkpoint written by writeCheckpoint() and restore the generator from it.
+ *
+ * @param[in] filename  checkpoint file
+ *
+ * @return generation state
+ */
+GenerationState DLAGenerator::readCheckpoint(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("DLAGenerator: readCheckpoint: Could not open file " + filename);
+    }
+
+    char magic[sizeof(kCheckpointMagic)];
+    file.read(magic, sizeof(magic));
+    if (!file || !std::equal(magic, magic + sizeof(magic), kCheckpointMagic)) {
+        throw std::runtime_error("DLAGenerator: readCheckpoint: Not a DLA checkpoint (or unsupported version): " + filename);
+    }
+
+    density_threshold_ = utils::readBinary<float>(file);
+    graph_center_y_ = utils::readBinary<float>(file);
+    graph_center_x_ = utils::readBinary<float>(file);
+    walk_mode_ = static_cast<WalkMode>(utils::readBinary<std::int32_t>(file));
+    spawn_mode_ = static_cast<SpawnMode>(utils::readBinary<std::int32_t>(file));
+
+    int aggregation = utils::readBinary<std::uint8_t>(file); // 0: one walker at a time, 1: batches, 2: batches with SIMD walkers
+    bool in_batches = aggregation > 0;
+    if (in_batches != (aggregation_threads_ > 0)) {
+        throw std::runtime_error("DLAGenerator: readCheckpoint: Checkpoint was written with aggregation_threads_ " + std::string(in_batches ? "> 0" : "= 0") + ", use the same mode to resume it");
+    }
+    simd_walkers_ = aggregation == 2;
+
+    walk_steps_ = utils::readBinary<std::int64_t>(file);
+
+    std::string rng_state(utils::readBinary<std::uint32_t>(file), '\0');
+    file.read(rng_state.data(), rng_state.size());
+    std::istringstream rng_stream(rng_state);
+    rng_stream >> rng_;
+
+    GenerationState state;
+    state.width = utils::readBinary<std::int32_t>(file);
+    state.level_width = utils::readBinary<std::int32_t>(file);
+    state.level_done = utils::readBinary<std::uint8_t>(file);
+    state.stream_key = utils::readBinary<std::uint64_t>(file);
+    state.walker_index = utils::readBinary<std::uint64_t>(file);
+    state.level_first_label = utils::readBinary<std::uint64_t>(file);
+
+    state.graph = Graph::readBinary(file);
+
+    int grid_width = utils::readBinary<std::int32_t>(file);
+    int grid_height = utils::readBinary<std::int32_t>(file);
+    if (!file || !rng_stream || grid_width < 0 || grid_height < 0) {
+        throw std::runtime_error("DLAGenerator: readCheckpoint: Corrupted checkpoint " + filename);
+    }
+
+    state.blurry_grid = Heightmap(grid_width, grid_height);
+    for (int y = 0; y < state.blurry_grid.height_; y++) {
+        std::span<float> row = state.blurry_grid.row(y);
+        file.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(float));
+    }
+
+    if (!file) {
+        throw std::runtime_error("DLAGenerator: readCheckpoint: Truncated checkpoint " + filename);
+    }
+
+    return state;
 }
 
 /**
@@ -1,12 +1,71 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <random>
+#include <string>
+#include <vector>
 
 #include "dla_graph.hh"
 #include "heightmap.hh"
 
+class ThreadPool;
+
 namespace DLA {
 
+/**
+ * @brief How walkers move in DLAGenerator::populateGraph()
+ */
+enum class WalkMode
+{
+    UNIT_STEPS, /**< walkers always move by 1 (original algorithm) */
+    DISTANCE_FIELD_JUMPS /**< walkers far from the graph jump on a circle as large as their distance to it */
+};
+
+/**
+ * @brief Where walkers start in DLAGenerator::populateGraph()
+ */
+enum class SpawnMode
+{
+    UNIFORM, /**< anywhere on the grid, away from the nodes (original algorithm) */
+    AGGREGATE_BAND /**< on a band just outside the graph, respawned there when they stray too far */
+};
+
+/**
+ * @brief Everything DLAGenerator::generateUpscaledHeightmap() needs to go on from where it stopped (saved in checkpoints)
+ */
+struct GenerationState
+{
+    int width = 0; /**< width of the final heightmap */
+    int level_width = 8; /**< width of the grid of the current level */
+    bool level_done = false; /**< false while the graph of the current level is being populated (already upscaled) */
+    Graph graph;
+    Heightmap blurry_grid = Heightmap(0, 0); /**< blurry grid of the last finished level */
+    std::uint64_t stream_key = 0; /**< walker streams of the current populateGraphInBatches() call */
+    std::uint64_t walker_index = 0; /**< next walker of the current populateGraphInBatches() call, 0 if it has not started */
+    std::uint64_t level_first_label = 0; /**< first label added by populateGraph() at the current level */
+};
+
+/**
+ * @brief Statistics of one level of DLAGenerator::generateUpscaledHeightmap() (times in seconds)
+ */
+struct LevelStats
+{
+    int width = 0; /**< width of the grid of the level */
+    size_t nodes = 0; /**< graph nodes at the end of the level (dummy node included) */
+    double upscale_graph_seconds = 0.0; /**< upscaleGraph() (0 for the base level) */
+    double populate_seconds = 0.0; /**< populateGraph() */
+    double height_values_seconds = 0.0; /**< setGraphHeightValues() */
+    double upscale_blurry_grid_seconds = 0.0; /**< upscaleBlurryGrid() and adding the graph heights to it */
+    double graph_to_heightmap_seconds = 0.0; /**< graphToHeightmap() */
+    double output_seconds = 0.0; /**< checkpoint */
+    long long walk_steps = 0; /**< walker moves of the level */
+    long long neighbour_queries = 0; /**< graph queries of the level (see DLAGenerator::neighbour_queries_) */
+    long peak_memory_kb = 0; /**< peak resident memory of the process during the level (only set by a level_end_hook_) */
+};
+
 // TODO: Experiment with generator hyperparameters to get different results
 class DLAGenerator // Diffusion Limited Aggregation
 {
@@ -18,10 +77,32 @@ private:
     static std::uniform_real_distribution<float> real_dist_1_zero_centered_;
     static std::uniform_real_distribution<float> real_dist_2pi_;
 
+    GenerationState* generation_ = nullptr; /**< state of the running generateUpscaledHeightmap(), for checkpoints */
+    std::shared_ptr<ThreadPool> aggregation_pool_; /**< threads of populateGraphInBatches(), kept between its calls */
+
+    ThreadPool& aggregationPool();
+
+    Heightmap runGeneration(GenerationState& state);
+    void checkpointIfDue(const Graph& graph, std::chrono::steady_clock::time_point& last_checkpoint);
+    void writeCheckpoint(const GenerationState& state);
+    GenerationState readCheckpoint(const std::string& filename);
+
 public:
     float density_threshold_; /**< grid density required to stop populating the grid */
     float graph_center_y_; /**< y ratio of the graph center (also first node). [0, 1) */ 
     float graph_center_x_; /**< x ratio of the graph center (also first node). [0, 1) */
+    WalkMode walk_mode_; /**< how walkers move, unit steps by default */
+    SpawnMode spawn_mode_; /**< where walkers start, anywhere by default */
+    long long walk_steps_; /**< number of walker moves so far (statistics to compare walk modes) */
+    long long neighbour_queries_; /**< number of graph neighbour queries by populateGraph() so far (not saved in checkpoints) */
+    std::vector<LevelStats> level_stats_; /**< levels run by the last generateUpscaledHeightmap() or resumeUpscaledHeightmap() */
+    std::string checkpoint_filename_; /**< where generateUpscaledHeightmap() saves its state after each level, empty for no checkpoints */
+    double checkpoint_interval_; /**< seconds between checkpoints inside populateGraph() too, 0 for only one per level */
+    unsigned int aggregation_threads_; /**< 0: one walker at a time (original algorithm), otherwise threads simulating walkers in batches (same result for any number) */
+    bool simd_walkers_; /**< with aggregation_threads_ > 0, move walkers by groups with SIMD steps and quantized directions (different result) */
+    bool debug_files_; /**< write the heightmap of each level and the final graph to images/DLA/ (not included in level_stats_) */
+    std::function<void()> level_start_hook_; /**< called before each level (e.g. to reset a measure), none by default */
+    std::function<void(LevelStats&)> level_end_hook_; /**< called with the statistics of each level before they are added to level_stats_ (e.g. to add a measure), none by default */
 
     DLAGenerator();
     DLAGenerator(float density_threshold);
@@ -30,6 +111,7 @@ public:
 
     std::array<float, 2> getRandom2DPixelCoordinates(int width, int height); // no real need to put it here but needs random engine class attribute
     void populateGraph(int width, Graph& graph);
+    void populateGraphInBatches(int width, Graph& graph);
 
     void upscaleGraph(Graph& graph);
     Heightmap upscaleBlurryGrid(const Heightmap& low_res_blurry_grid);
@@ -46,6 +128,16 @@ public:
      */
     Heightmap generateUpscaledHeightmap(int width);
 
+    /**
+     * @brief Finish a generateUpscaledHeightmap() run from one of its checkpoints, with the same result as an
+     * uninterrupted run. The generator parameters (density, graph center, walk and spawn modes, SIMD walkers) are restored from the checkpoint.
+     *
+     * @param[in] checkpoint_filename  checkpoint written by a previous run (see checkpoint_filename_)
+     *
+     * @return square heightmap representing some terrain (mountains)
+     */
+    Heightmap resumeUpscaledHeightmap(const std::string& checkpoint_filename);
+
     /**
      * @brief Generate the base heightmap (for the mesh) and the upscaled heightmap (for the texture map and the normal map).
      * The upscaled heightmap will be generated by the DLA algorithm. Base heightmap is a downsampled version of the upscaled heightmap.
@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
+#include <stdexcept>
 #include <string>
 
 #include "utils.hh"
@@ -10,40 +12,288 @@
 namespace DLA {
 
 /**
- * @brief Construct a new Graph object. Add a dummy node at the beginning (nullptr in node list and empty list in adjacency list).
+ * @brief Construct a new Graph object. Add a dummy node at the beginning (at (0, 0), without any edge).
  */
 Graph::Graph() {
-    adjacency_list_ = std::vector<std::vector<int>>();
-    nodes_list_ = std::vector<std::shared_ptr<Node>>();
+    y_.push_back(0.0f);
+    x_.push_back(0.0f);
+    height_.push_back(-1.0f);
 
-    adjacency_list_.push_back(std::vector<int>());
-    nodes_list_.push_back(nullptr);
+    adjacency_begin_.push_back(0);
+    degree_.push_back(0);
+    adjacency_capacity_.push_back(0);
+
+    parent_.push_back(-1);
+    tree_height_.push_back(0);
+    tree_heights_valid_ = false;
+
+    grid_width_ = 0;
+}
+
+/**
+ * @brief Index of the grid cell containing given coordinates, coordinates outside the grid go to the closest border cell.
+ *
+ * @param[in] grid_width  width of the square grid
+ * @param[in] coordinate  y or x coordinate
+ *
+ * @return row or column of the cell
+ */
+static int gridCellOf(int grid_width, float coordinate) {
+    return std::clamp(static_cast<int>(std::floor(coordinate)), 0, grid_width - 1);
+}
+
+/**
+ * @brief Add a node without any edge to the graph (and to the bucket grid if there is one).
+ *
+ * @param[in] y  y coordinate of the node
+ * @param[in] x  x coordinate of the node
+ *
+ * @return label of the new node
+ */
+int Graph::addNode(float y, float x) {
+    int label = y_.size();
+    y_.push_back(y);
+    x_.push_back(x);
+    height_.push_back(-1.0f);
+
+    adjacency_begin_.push_back(adjacency_.size());
+    degree_.push_back(0);
+    adjacency_capacity_.push_back(0);
+
+    parent_.push_back(-1);
+    tree_height_.push_back(0);
+
+    if (grid_width_ > 0) {
+        grid_buckets_[gridCellOf(grid_width_, y) * grid_width_ + gridCellOf(grid_width_, x)].push_back(label);
+    }
+
+    return label;
+}
+
+/**
+ * @brief (Re)build the bucket grid used by radius queries for a square area of the given width.
+ * Cells are 1x1, radius queries of the DLA walks (up to 1) only look at the 3x3 cells around them.
+ * Has to be called again whenever node positions are changed (see DLAGenerator::upscaleGraph()).
+ *
+ * @param[in] width  width of the square area the nodes lie in
+ */
+void Graph::setGridWidth(int width) {
+    grid_width_ = width;
+    grid_buckets_.assign(static_cast<size_t>(width) * width, {});
+
+    for (size_t i = 1; i < size(); i++) {
+        grid_buckets_[gridCellOf(width, y_[i]) * width + gridCellOf(width, x_[i])].push_back(i);
+    }
 }
 
 /**
  * @brief Check if there are graph nodes in a certain radius around given coordinates.
+ * Only the grid cells overlapping the query square are visited (all the nodes without a grid).
  *
  * @param[in] y       y given coordinate
  * @param[in] x       x given coordinate
  * @param[in] radius  radius around the given coordinates
  *
- * @return vector of node labels around the given coordinates, empty if none
+ * @return vector of node labels around the given coordinates (sorted), empty if none
  */
-std::vector<int> Graph::getNodesAround(float y, float x, float radius) {
+std::vector<int> Graph::getNodesAround(float y, float x, float radius) const {
     std::vector<int> labels_around = {};
 
-    for (size_t i = 1; i < nodes_list_.size(); i++) {
-        float node_y = nodes_list_[i]->y_;
-        float node_x = nodes_list_[i]->x_;
+    if (grid_width_ == 0) {
+        for (size_t i = 1; i < size(); i++) {
+            if (utils::euclidianDistance(y, x, y_[i], x_[i]) <= radius) {
+                labels_around.push_back(i);
+            }
+        }
+
+        return labels_around;
+    }
 
-        if (utils::euclidianDistance(y, x, node_y, node_x) <= radius) {
-            labels_around.push_back(i);
+    int min_row = gridCellOf(grid_width_, y - radius);
+    int max_row = gridCellOf(grid_width_, y + radius);
+    int min_col = gridCellOf(grid_width_, x - radius);
+    int max_col = gridCellOf(grid_width_, x + radius);
+
+    for (int row = min_row; row <= max_row; row++) {
+        for (int col = min_col; col <= max_col; col++) {
+            for (int label : grid_buckets_[row * grid_width_ + col]) {
+                if (utils::euclidianDistance(y, x, y_[label], x_[label]) <= radius) {
+                    labels_around.push_back(label);
+                }
+            }
         }
     }
 
+    // same order as a scan of the whole node list
+    std::sort(labels_around.begin(), labels_around.end());
+
     return labels_around;
 }
 
+/**
+ * @brief Same as getNodesAround() but stops at the first node found.
+ *
+ * @param[in] y       y given coordinate
+ * @param[in] x       x given coordinate
+ * @param[in] radius  radius around the given coordinates
+ *
+ * @return true if there is at least one node around the given coordinates
+ */
+bool Graph::hasNodesAround(float y, float x, float radius) const {
+    if (grid_width_ == 0) {
+        return !getNodesAround(y, x, radius).empty();
+    }
+
+    int min_row = gridCellOf(grid_width_, y - radius);
+    int max_row = gridCellOf(grid_width_, y + radius);
+    int min_col = gridCellOf(grid_width_, x - radius);
+    int max_col = gridCellOf(grid_width_, x + radius);
+
+    for (int row = min_row; row <= max_row; row++) {
+        for (int col = min_col; col <= max_col; col++) {
+            for (int label : grid_buckets_[row * grid_width_ + col]) {
+                if (utils::euclidianDistance(y, x, y_[label], x_[label]) <= radius) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Append a label to the adjacency list of a node, moving the list to a twice larger block at the end of the
+ * adjacency array when its block is full.
+ *
+ * @param[in] label           label of the node
+ * @param[in] neighbour_label label to append
+ */
+void Graph::appendNeighbour(int label, int neighbour_label) {
+    if (degree_[label] == adjacency_capacity_[label]) {
+        int new_begin = adjacency_.size();
+        int new_capacity = std::max(4, 2 * adjacency_capacity_[label]);
+
+        adjacency_.resize(adjacency_.size() + new_capacity);
+        std::copy_n(adjacency_.begin() + adjacency_begin_[label], degree_[label], adjacency_.begin() + new_begin);
+
+        adjacency_begin_[label] = new_begin;
+        adjacency_capacity_[label] = new_capacity;
+    }
+
+    adjacency_[adjacency_begin_[label] + degree_[label]] = neighbour_label;
+    degree_[label]++;
+}
+
+/**
+ * @brief Graph is undirected, so we add the edge to both nodes' adjacency list.
+ *
+ * @param[in] node1_label  label of the first node
+ * @param[in] node2_label  label of the second node
+ */
+void Graph::addEdge(int node1_label, int node2_label) {
+    appendNeighbour(node1_label, node2_label);
+    appendNeighbour(node2_label, node1_label);
+    tree_heights_valid_ = false;
+}
+
+/**
+ * @brief Add an edge between a new node and a node of the tree, updating the tree heights of its ancestors:
+ * going up from the new leaf, only as long as the longest downstream path grows.
+ * (A root with a single neighbour counts as a leaf, like the other nodes with a single neighbour.)
+ *
+ * @param[in] label         label of the new node (without any edge yet)
+ * @param[in] parent_label  label of the node it is attached to
+ */
+void Graph::attachLeaf(int label, int parent_label) {
+    appendNeighbour(label, parent_label);
+    appendNeighbour(parent_label, label);
+
+    if (!tree_heights_valid_) {
+        return;
+    }
+
+    parent_[label] = parent_label;
+    tree_height_[label] = 1;
+
+    int child = label;
+    int node = parent_label;
+
+    while (node != 0) {
+        int height;
+
+        if (degree_[node] == 1) {
+            height = 1;
+        } else if (parent_[node] == 0) {
+            // the root may have counted as a leaf until now, so look at all its children
+            height = 0;
+            for (int neighbour_label : neighbours(node)) {
+                height = std::max(height, tree_height_[neighbour_label] + 1);
+            }
+        } else {
+            height = std::max(tree_height_[node], tree_height_[child] + 1);
+        }
+
+        if (height == tree_height_[node]) {
+            break;
+        }
+
+        tree_height_[node] = height;
+        child = node;
+        node = parent_[node];
+    }
+}
+
+/**
+ * @brief Compute the parents and tree heights of all the nodes from scratch:
+ * breadth-first order from node 1, then heights from the last node of that order to the first one (children first).
+ */
+void Graph::computeTreeHeights() {
+    std::fill(parent_.begin(), parent_.end(), -1);
+
+    std::vector<int> order;
+    order.reserve(size());
+    order.push_back(1);
+    parent_[1] = 0;
+
+    for (size_t k = 0; k < order.size(); k++) {
+        for (int neighbour_label : neighbours(order[k])) {
+            if (parent_[neighbour_label] == -1) {
+                parent_[neighbour_label] = order[k];
+                order.push_back(neighbour_label);
+            }
+        }
+    }
+
+    if (order.size() != size() - 1) {
+        throw std::runtime_error("DLA Graph: computeTreeHeights: Some nodes are not connected to node 1");
+    }
+
+    for (size_t k = order.size(); k-- > 0;) {
+        int label = order[k];
+
+        if (degree_[label] <= 1) {
+            tree_height_[label] = 1;
+            continue;
+        }
+
+        int height = 0;
+        for (int neighbour_label : neighbours(label)) {
+            if (parent_[neighbour_label] == label) {
+                height = std::max(height, tree_height_[neighbour_label] + 1);
+            }
+        }
+
+        if (height == 0) {
+            throw std::runtime_error("DLA Graph: computeTreeHeights: Could not find a downstream node for node " + std::to_string(label));
+        }
+
+        tree_height_[label] = height;
+    }
+
+    tree_heights_valid_ = true;
+}
+
 /**
  * @brief Graph is undirected, so we add the edge to both nodes' adjacency list.
  *
@@ -51,15 +301,23 @@ std::vector<int> Graph::getNodesAround(float y, float x, float radius) {
  */
 void Graph::addEdges(const std::vector<std::array<int, 2>>& edges_to_add) {
     for (const auto& edge : edges_to_add) {
-        int node1_label = edge[0];
-        int node2_label = edge[1];
-
-        // add the edge to the adjacency list
-        adjacency_list_[node1_label].push_back(node2_label);
-        adjacency_list_[node2_label].push_back(node1_label);
+        addEdge(edge[0], edge[1]);
     }
 }
 
+/**
+ * @brief Remove a label from the adjacency list of a node (order of the other labels is kept).
+ *
+ * @param[in] label           label of the node
+ * @param[in] neighbour_label label to remove
+ */
+void Graph::removeNeighbour(int label, int neighbour_label) {
+    auto begin = adjacency_.begin() + adjacency_begin_[label];
+    auto end = begin + degree_[label];
+
+    degree_[label] = std::remove(begin, end, neighbour_label) - begin;
+}
+
 /**
  * @brief Graph is undirected, so we remove the edge from both nodes' adjacency list.
  *
@@ -67,13 +325,41 @@ void Graph::addEdges(const std::vector<std::array<int, 2>>& edges_to_add) {
  */
 void Graph::removeEdges(const std::vector<std::array<int, 2>>& edges_to_remove) {
     for (const auto& edge : edges_to_remove) {
-        int node1_label = edge[0];
-        int node2_label = edge[1];
+        removeNeighbour(edge[0], edge[1]);
+        removeNeighbour(edge[1], edge[0]);
+    }
+
+    tree_heights_valid_ = false;
+}
+
+/**
+ * @brief Replace all the edges of the graph, the adjacency lists are rebuilt without any unused space
+ * (counting the degrees first, then filling the lists).
+ *
+ * @param[in] edges  edges of the graph, neighbours are listed in the order of this vector
+ */
+void Graph::replaceEdges(const std::vector<std::array<int, 2>>& edges) {
+    std::fill(degree_.begin(), degree_.end(), 0);
+    for (const auto& edge : edges) {
+        degree_[edge[0]]++;
+        degree_[edge[1]]++;
+    }
 
-        // erase-remove idiom
-        adjacency_list_[node1_label].erase(std::remove(adjacency_list_[node1_label].begin(), adjacency_list_[node1_label].end(), node2_label), adjacency_list_[node1_label].end());
-        adjacency_list_[node2_label].erase(std::remove(adjacency_list_[node2_label].begin(), adjacency_list_[node2_label].end(), node1_label), adjacency_list_[node2_label].end());
-    } 
+    int begin = 0;
+    for (size_t i = 0; i < size(); i++) {
+        adjacency_begin_[i] = begin;
+        adjacency_capacity_[i] = degree_[i];
+        begin += degree_[i];
+    }
+
+    adjacency_.assign(begin, 0);
+    std::fill(degree_.begin(), degree_.end(), 0);
+    for (const auto& edge : edges) {
+        adjacency_[adjacency_begin_[edge[0]] + degree_[edge[0]]++] = edge[1];
+        adjacency_[adjacency_begin_[edge[1]] + degree_[edge[1]]++] = edge[0];
+    }
+
+    tree_heights_valid_ = false;
 }
 
 /**
@@ -90,9 +376,9 @@ void Graph::exportToDot(const std::string& filename) {
 
     file << "graph DLA {" << std::endl;
 
-    for (size_t i = 1; i < adjacency_list_.size(); i++) {
-        for (size_t j = 0; j < adjacency_list_[i].size(); j++) {
-            file << "    " << nodes_list_[i]->label_ << " -- " << nodes_list_[adjacency_list_[i][j]]->label_ << ";" << std::endl;
+    for (size_t i = 1; i < size(); i++) {
+        for (int neighbour_label : neighbours(i)) {
+            file << "    " << node(i).label_ << " -- " << node(neighbour_label).label_ << ";" << std::endl;
         }
     }
 
@@ -111,11 +397,94 @@ void Graph::exportNodesHeight(const std::string& filename) {
         throw std::runtime_error("DLA Graph: exportNodesHeight: Could not open file " + filename);
     }
 
-    for (size_t i = 1; i < nodes_list_.size(); i++) {
-        file << "Node " << i << ": " << nodes_list_[i]->height_ << std::endl;
+    for (size_t i = 1; i < size(); i++) {
+        file << "Node " << i << ": " << height_[i] << std::endl;
     }
 
     file.close();
 }
 
-} // namespace DLA
\ No newline at end of file
+/**
+ * @brief Write the nodes (position and height), the edges and the grid width in a compact binary form.
+ * Labels are not written, they are the positions in the lists.
+ *
+ * @param[in, out] os  binary output stream
+ */
+void Graph::writeBinary(std::ostream& os) const {
+    utils::writeBinary<std::uint32_t>(os, size());
+    for (size_t i = 1; i < size(); i++) {
+        utils::writeBinary(os, y_[i]);
+        utils::writeBinary(os, x_[i]);
+        utils::writeBinary(os, height_[i]);
+    }
+
+    for (size_t i = 1; i < size(); i++) {
+        std::span<const int> labels = neighbours(i);
+        utils::writeBinary<std::uint32_t>(os, labels.size());
+        os.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(int));
+    }
+
+    utils::writeBinary<std::int32_t>(os, grid_width_);
+}
+
+/**
+ * @brief Read a graph written by writeBinary() (bucket grid rebuilt).
+ *
+ * @param[in, out] is  binary input stream
+ *
+ * @return the read graph
+ */
+Graph Graph::readBinary(std::istream& is) {
+    Graph graph;
+
+    std::uint32_t nodes_count = utils::readBinary<std::uint32_t>(is);
+    if (!is || nodes_count == 0) {
+        throw std::runtime_error("DLA Graph: readBinary: Invalid graph");
+    }
+
+    for (std::uint32_t i = 1; i < nodes_count; i++) {
+        float y = utils::readBinary<float>(is);
+        float x = utils::readBinary<float>(is);
+        int label = graph.addNode(y, x);
+        graph.height_[label] = utils::readBinary<float>(is);
+    }
+
+    // lists are written one after the other, so they are read directly into a compact adjacency array
+    for (std::uint32_t i = 1; i < nodes_count; i++) {
+        std::uint32_t neighbours_count = utils::readBinary<std::uint32_t>(is);
+        if (!is || neighbours_count >= nodes_count) {
+            throw std::runtime_error("DLA Graph: readBinary: Invalid adjacency list for node " + std::to_string(i));
+        }
+
+        graph.adjacency_begin_[i] = graph.adjacency_.size();
+        graph.degree_[i] = neighbours_count;
+        graph.adjacency_capacity_[i] = neighbours_count;
+
+        graph.adjacency_.resize(graph.adjacency_.size() + neighbours_count);
+        is.read(reinterpret_cast<char*>(graph.adjacency_.data() + graph.adjacency_begin_[i]), neighbours_count * sizeof(int));
+
+        if (!is) {
+            throw std::runtime_error("DLA Graph: readBinary: Truncated graph");
+        }
+
+        // the dummy node has no edge
+        for (int label : graph.neighbours(i)) {
+            if (label <= 0 || static_cast<std::uint32_t>(label) >= nodes_count) {
+                throw std::runtime_error("DLA Graph: readBinary: Invalid neighbour " + std::to_string(label) + " of node " + std::to_string(i));
+            }
+        }
+    }
+
+    int grid_width = utils::readBinary<std::int32_t>(is);
+    if (!is) {
+        throw std::runtime_error("DLA Graph: readBinary: Truncated graph");
+    }
+
+    if (grid_width > 0) {
+        graph.setGridWidth(grid_width);
+    }
+
+    return graph;
+}
+
+} // namespace DLA
@@ -1,7 +1,9 @@
 #pragma once
 
-#include <memory>
+#include <array>
+#include <istream>
 #include <ostream>
+#include <span>
 #include <vector>
 
 namespace DLA {
@@ -23,17 +25,70 @@ inline std::ostream& operator<<(std::ostream& os, const Node& node)
 
 struct Graph
 {
-    using AdjacencyList = std::vector<std::vector<int>>; // adjacency list representation of the graph (by label, position in the list is the label of the node)
-    using NodesList = std::vector<std::shared_ptr<Node>>; // list of nodes in the graph (position of the node in the vector should be the label of the node)
+    // Nodes attributes by label (structure of arrays), label 0 is a dummy node
+    std::vector<float> y_;
+    std::vector<float> x_;
+    std::vector<float> height_;
 
-    AdjacencyList adjacency_list_;
-    NodesList nodes_list_;
+    // Adjacency lists of all the nodes in one array (CSR-like): the neighbours of a node are the degree_[label] labels
+    // starting at adjacency_begin_[label]. A node whose block is full gets a twice larger one at the end of the array
+    // (the old block stays unused until the edges are replaced).
+    std::vector<int> adjacency_;
+    std::vector<int> adjacency_begin_;
+    std::vector<int> degree_;
+    std::vector<int> adjacency_capacity_;
+
+    // Tree rooted at node 1 (DLA graphs are trees): parent of each node (0 for the root, -1 when not attached yet) and
+    // number of nodes of the longest downstream path from each node (1 for leaves). Only meaningful when
+    // tree_heights_valid_, kept up to date by attachLeaf()
+    std::vector<int> parent_;
+    std::vector<int> tree_height_;
+    bool tree_heights_valid_;
+
+    int grid_width_; /**< width of the square area covered by the bucket grid, 0 when there is no grid yet */
+    std::vector<std::vector<int>> grid_buckets_; /**< node labels per 1x1 cell of the grid, row-major */
 
     /**
      * @brief Construct a new Graph object. Add a dummy node at the beginning.
      */
     Graph();
 
+    /**
+     * @return number of labels (dummy node included)
+     */
+    size_t size() const { return y_.size(); }
+
+    /**
+     * @param[in] label  label of a node
+     *
+     * @return copy of the node attributes
+     */
+    Node node(int label) const { return Node{ label, y_[label], x_[label], height_[label] }; }
+
+    /**
+     * @param[in] label  label of a node
+     *
+     * @return labels of the nodes linked to the given one
+     */
+    std::span<const int> neighbours(int label) const { return { adjacency_.data() + adjacency_begin_[label], static_cast<size_t>(degree_[label]) }; }
+
+    /**
+     * @brief Add a node without any edge to the graph (and to the bucket grid if there is one).
+     *
+     * @param[in] y  y coordinate of the node
+     * @param[in] x  x coordinate of the node
+     *
+     * @return label of the new node
+     */
+    int addNode(float y, float x);
+
+    /**
+     * @brief (Re)build the bucket grid used by radius queries for a square area of the given width.
+     *
+     * @param[in] width  width of the square area the nodes lie in
+     */
+    void setGridWidth(int width);
+
     /**
      * @brief Check if there are graph nodes in a certain radius around given coordinates.
      *
@@ -43,7 +98,39 @@ struct Graph
      *
      * @return vector of node labels around the given coordinates, empty if none
      */
-    std::vector<int> getNodesAround(float y, float x, float radius);
+    std::vector<int> getNodesAround(float y, float x, float radius) const;
+
+    /**
+     * @brief Same as getNodesAround() but stops at the first node found.
+     *
+     * @param[in] y       y given coordinate
+     * @param[in] x       x given coordinate
+     * @param[in] radius  radius around the given coordinates
+     *
+     * @return true if there is at least one node around the given coordinates
+     */
+    bool hasNodesAround(float y, float x, float radius) const;
+
+    /**
+     * @brief Add an edge between two nodes (to both adjacency lists).
+     *
+     * @param[in] node1_label  label of the first node
+     * @param[in] node2_label  label of the second node
+     */
+    void addEdge(int node1_label, int node2_label);
+
+    /**
+     * @brief Add an edge between a new node and a node of the tree, updating the tree heights of its ancestors.
+     *
+     * @param[in] label         label of the new node (without any edge yet)
+     * @param[in] parent_label  label of the node it is attached to
+     */
+    void attachLeaf(int label, int parent_label);
+
+    /**
+     * @brief Compute the parents and tree heights of all the nodes from scratch.
+     */
+    void computeTreeHeights();
 
     /**
      * @param[in] edges_to_add  A vector of pairs of integers containing edge labels to add to the graph.
@@ -55,6 +142,13 @@ struct Graph
      */
     void removeEdges(const std::vector<std::array<int, 2>>& edges_to_remove);
 
+    /**
+     * @brief Replace all the edges of the graph, the adjacency lists are rebuilt without any unused space.
+     *
+     * @param[in] edges  edges of the graph, neighbours are listed in the order of this vector
+     */
+    void replaceEdges(const std::vector<std::array<int, 2>>& edges);
+
     /**
      * @brief Export the graph under the DOT format (.dot).
      * Can be exported to png using graphviz: `dot -Tpng graph.dot -o graph.png`
@@ -69,6 +163,26 @@ struct Graph
      * @param[in] filename  The name of the file to export the nodes' height to.
      */
     void exportNodesHeight(const std::string& filename);
+
+    /**
+     * @brief Write the nodes (position and height), the edges and the grid width in a compact binary form.
+     *
+     * @param[in, out] os  binary output stream
+     */
+    void writeBinary(std::ostream& os) const;
+
+    /**
+     * @brief Read a graph written by writeBinary() (bucket grid rebuilt).
+     *
+     * @param[in, out] is  binary input stream
+     *
+     * @return the read graph
+     */
+    static Graph readBinary(std::istream& is);
+
+private:
+    void appendNeighbour(int label, int neighbour_label);
+    void removeNeighbour(int label, int neighbour_label);
 };
 
 } // namespace DLA
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "dla_walker_group.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "utils.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define WALKER_GROUP_X86
+#endif
+
+namespace DLA {
+
+/**
+ * @brief Construct an occupancy grid without any marked cell.
+ *
+ * @param[in] width  width of the square grid
+ */
+OccupancyGrid::OccupancyGrid(int width)
+    : width_(width)
+    , near_(static_cast<size_t>(width) * width + 3, 0) // gathers read 4 bytes from the last cell
+{}
+
+/**
+ * @brief Mark the cells around a node: any point within a distance 1 of the node is in one of the 3x3 cells around
+ * the cell of the node.
+ *
+ * @param[in] y  y coordinate of the node
+ * @param[in] x  x coordinate of the node
+ */
+void OccupancyGrid::markNode(float y, float x) {
+    int row = std::clamp(static_cast<int>(y), 0, width_ - 1);
+    int col = std::clamp(static_cast<int>(x), 0, width_ - 1);
+
+    for (int r = std::max(0, row - 1); r <= std::min(width_ - 1, row + 1); r++) {
+        for (int c = std::max(0, col - 1); c <= std::min(width_ - 1, col + 1); c++) {
+            near_[r * width_ + c] = 1;
+        }
+    }
+}
+
+/**
+ * @brief Unit vectors of the walker directions, evenly spread on the circle.
+ */
+struct DirectionTable
+{
+    alignas(32) std::array<float, WalkerGroup::kDirections> y_;
+    alignas(32) std::array<float, WalkerGroup::kDirections> x_;
+
+    DirectionTable() {
+        for (int i = 0; i < WalkerGroup::kDirections; i++) {
+            float theta = 2 * utils::pi * i / WalkerGroup::kDirections;
+            y_[i] = std::sin(theta);
+            x_[i] = std::cos(theta);
+        }
+    }
+};
+
+static const DirectionTable directions_;
+
+float WalkerGroup::directionY(int direction) {
+    return directions_.y_[direction];
+}
+
+float WalkerGroup::directionX(int direction) {
+    return directions_.x_[direction];
+}
+
+using StepKernel = unsigned (*)(WalkerGroup&, unsigned, const OccupancyGrid&, unsigned&);
+
+/**
+ * @brief Scalar step of the walkers (reference for the other kernels).
+ */
+static unsigned stepScalar(WalkerGroup& group, unsigned active_mask, const OccupancyGrid& occupancy, unsigned& moved_mask) {
+    const float width = occupancy.width_;
+    unsigned near_mask = 0;
+    moved_mask = 0;
+
+    for (int lane = 0; lane < WalkerGroup::kLanes; lane++) {
+        if (!(active_mask & (1u << lane))) {
+            continue;
+        }
+
+        float y = group.y_[lane] + directions_.y_[group.direction_[lane]];
+        float x = group.x_[lane] + directions_.x_[group.direction_[lane]];
+
+        if (!(y >= 0.0f && y < width && x >= 0.0f && x < width)) {
+            continue;
+        }
+
+        if (occupancy.isNear(y, x)) {
+            near_mask |= 1u << lane;
+        } else {
+            group.y_[lane] = y;
+            group.x_[lane] = x;
+            moved_mask |= 1u << lane;
+        }
+    }
+
+    return near_mask;
+}
+
+#ifdef WALKER_GROUP_X86
+
+// Same operations as stepScalar (one float addition per coordinate), so both kernels agree bit for bit
+
+__attribute__((target("avx2"))) static unsigned stepAvx2(WalkerGroup& group, unsigned active_mask, const OccupancyGrid& occupancy, unsigned& moved_mask) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 width = _mm256_set1_ps(static_cast<float>(occupancy.width_));
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+    __m256i direction = _mm256_load_si256(reinterpret_cast<const __m256i*>(group.direction_));
+    __m256 y = _mm256_add_ps(_mm256_load_ps(group.y_), _mm256_i32gather_ps(directions_.y_.data(), direction, 4));
+    __m256 x = _mm256_add_ps(_mm256_load_ps(group.x_), _mm256_i32gather_ps(directions_.x_.data(), direction, 4));
+
+    __m256i active = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(active_mask), lane_bits), lane_bits);
+    __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ), _mm256_cmp_ps(y, width, _CMP_LT_OQ)),
+                                  _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ), _mm256_cmp_ps(x, width, _CMP_LT_OQ)));
+    __m256i candidates = _mm256_and_si256(active, _mm256_castps_si256(inside));
+
+    // occupancy bytes of the destination cells (cells of the other lanes are not read)
+    __m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(y), _mm256_set1_epi32(occupancy.width_)), _mm256_cvttps_epi32(x));
+    __m256i bytes = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(occupancy.near_.data()), cell, candidates, 1);
+    __m256i near = _mm256_cmpgt_epi32(_mm256_and_si256(bytes, _mm256_set1_epi32(0xFF)), _mm256_setzero_si256());
+
+    __m256i near_lanes = _mm256_and_si256(candidates, near);
+    __m256i moved_lanes = _mm256_andnot_si256(near, candidates);
+
+    _mm256_store_ps(group.y_, _mm256_blendv_ps(_mm256_load_ps(group.y_), y, _mm256_castsi256_ps(moved_lanes)));
+    _mm256_store_ps(group.x_, _mm256_blendv_ps(_mm256_load_ps(group.x_), x, _mm256_castsi256_ps(moved_lanes)));
+
+    moved_mask = _mm256_movemask_ps(_mm256_castsi256_ps(moved_lanes));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(near_lanes));
+}
+
+#endif
+
+static StepKernel selectKernel(const char*& name) {
+#ifdef WALKER_GROUP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        name = "avx2";
+        return stepAvx2;
+    }
+#endif
+    name = "scalar";
+    return stepScalar;
+}
+
+static const char* kernel_name_ = nullptr;
+static const StepKernel kernel_ = selectKernel(kernel_name_);
+
+/**
+ * @brief Move the walkers of active_mask by one unit in their direction, if they stay in the grid and go to a cell
+ * that is not marked. Walkers going out of the grid do not move.
+ *
+ * @param[in] active_mask   walkers to move (bit i for walker i)
+ * @param[in] occupancy     occupancy grid of the graph
+ * @param[out] moved_mask   walkers that moved
+ *
+ * @return walkers that stay in the grid but go to a marked cell (not moved, see destination())
+ */
+unsigned WalkerGroup::step(unsigned active_mask, const OccupancyGrid& occupancy, unsigned& moved_mask) {
+    return kernel_(*this, active_mask, occupancy, moved_mask);
+}
+
+const char* WalkerGroup::kernelName() {
+    return kernel_name_;
+}
+
+} // namespace DLA
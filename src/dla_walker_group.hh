@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DLA {
+
+/**
+ * @brief Cells (1x1) of a square grid that may be within a distance 1 of a graph node: the 3x3 cells around the cell of
+ * each node are marked. A walker in a cell that is not marked can neither stick to a node nor be too close to one.
+ */
+class OccupancyGrid
+{
+public:
+    int width_;
+    std::vector<std::uint8_t> near_; /**< 1 for marked cells, row-major (+ padding for 32 bit gathers) */
+
+    /**
+     * @param[in] width  width of the square grid
+     */
+    OccupancyGrid(int width);
+
+    /**
+     * @brief Mark the cells around a node.
+     *
+     * @param[in] y  y coordinate of the node
+     * @param[in] x  x coordinate of the node
+     */
+    void markNode(float y, float x);
+
+    /**
+     * @param[in] y  y coordinate (inside the grid)
+     * @param[in] x  x coordinate (inside the grid)
+     *
+     * @return true if there may be a node within a distance 1 of the given coordinates
+     */
+    bool isNear(float y, float x) const { return near_[static_cast<int>(y) * width_ + static_cast<int>(x)] != 0; }
+};
+
+/**
+ * @brief Up to kLanes walkers moved together by unit steps, in one of kDirections directions (table lookups instead of
+ * sin/cos), with vectorized grid bounds and occupancy checks. Only the walkers going to a marked cell of the
+ * OccupancyGrid are left to the caller, to be checked against the graph nodes.
+ * The kernel is picked at runtime: AVX2 (8 walkers per instruction) or a scalar fallback, both give the same positions.
+ */
+class WalkerGroup
+{
+public:
+    static constexpr int kLanes = 8;
+    static constexpr int kDirections = 256;
+
+    alignas(32) float y_[kLanes] = {};
+    alignas(32) float x_[kLanes] = {};
+    alignas(32) std::int32_t direction_[kLanes] = {}; /**< direction of the next step of each walker (table index) */
+
+    /**
+     * @brief Move the walkers of active_mask by one unit in their direction, if they stay in the grid and go to a cell
+     * that is not marked. Walkers going out of the grid do not move.
+     *
+     * @param[in] active_mask   walkers to move (bit i for walker i)
+     * @param[in] occupancy     occupancy grid of the graph
+     * @param[out] moved_mask   walkers that moved
+     *
+     * @return walkers that stay in the grid but go to a marked cell (not moved, see destination())
+     */
+    unsigned step(unsigned active_mask, const OccupancyGrid& occupancy, unsigned& moved_mask);
+
+    /**
+     * @param[in] lane  walker index
+     *
+     * @return y and x coordinates of the walker after a unit step in its direction
+     */
+    float destinationY(int lane) const { return y_[lane] + directionY(direction_[lane]); }
+    float destinationX(int lane) const { return x_[lane] + directionX(direction_[lane]); }
+
+    /**
+     * @param[in] direction  table index
+     *
+     * @return y (sine) and x (cosine) components of the unit vector of the direction
+     */
+    static float directionY(int direction);
+    static float directionX(int direction);
+
+    /**
+     * @return name of the kernel used on this CPU
+     */
+    static const char* kernelName();
+};
+
+} // namespace DLA
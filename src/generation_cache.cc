@@ -0,0 +1,298 @@
+#include "generation_cache.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "heightmap_file.hh"
+
+static constexpr uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+static constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+// Cached images: "I2DC", format (uint32), width and height (int32), then the
+// pixel buffer of the format
+static constexpr char kImageMagic[4] = { 'I', '2', 'D', 'C' };
+
+CacheKey::CacheKey(const std::string &kind)
+    : hash_(kFnvOffsetBasis)
+{
+    add(kind);
+}
+
+void CacheKey::add_bytes(const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash_ ^= bytes[i];
+        hash_ *= kFnvPrime;
+    }
+}
+
+CacheKey &CacheKey::add(double value)
+{
+    add_bytes(&value, sizeof(value));
+    return *this;
+}
+
+CacheKey &CacheKey::add(int value)
+{
+    add_bytes(&value, sizeof(value));
+    return *this;
+}
+
+CacheKey &CacheKey::add(const std::string &value)
+{
+    // (the size separates consecutive strings)
+    add(static_cast<int>(value.size()));
+    add_bytes(value.data(), value.size());
+    return *this;
+}
+
+CacheKey &CacheKey::add(const Color &color)
+{
+    return add(color.r_).add(color.g_).add(color.b_).add(color.a_);
+}
+
+CacheKey &CacheKey::add(const Vector3 &vector)
+{
+    return add(vector.x_).add(vector.y_).add(vector.z_);
+}
+
+CacheKey &CacheKey::add(const Heightmap &heightmap)
+{
+    add(heightmap.width_).add(heightmap.height_);
+    for (int y = 0; y < heightmap.height_; y++)
+    {
+        std::span<const float> row = heightmap.row(y);
+        add_bytes(row.data(), row.size_bytes());
+    }
+    return *this;
+}
+
+CacheKey &CacheKey::add(const Image2D &image)
+{
+    add(image.width_).add(image.height_).add(static_cast<int>(image.format_));
+    if (image.format_ == PixelFormat::RGBA_FLOAT)
+        add_bytes(image.pixels_.data(), image.pixels_.size() * sizeof(float));
+    else
+        add_bytes(image.pixels_8_.data(), image.pixels_8_.size());
+    return *this;
+}
+
+CacheKey &CacheKey::add(const CacheKey &key)
+{
+    add_bytes(&key.hash_, sizeof(key.hash_));
+    return *this;
+}
+
+CacheKey &CacheKey::add_file(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        return add(std::string("missing file ") + filename);
+
+    std::vector<char> buffer(1 << 16);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        add_bytes(buffer.data(), file.gcount());
+    }
+    return *this;
+}
+
+std::string CacheKey::hex() const
+{
+    char digits[17];
+    std::snprintf(digits, sizeof(digits), "%016llx",
+                  static_cast<unsigned long long>(hash_));
+    return digits;
+}
+
+GenerationCache::GenerationCache(const std::string &directory)
+    : enabled_(true)
+    , directory_(directory)
+{}
+
+GenerationCache &GenerationCache::shared()
+{
+    static GenerationCache cache("../images/cache");
+    return cache;
+}
+
+std::string GenerationCache::path(const CacheKey &key,
+                                  const std::string &extension) const
+{
+    return directory_ + "/" + key.hex() + extension;
+}
+
+bool GenerationCache::load(const CacheKey &key, Heightmap &heightmap) const
+{
+    std::string filename = path(key, ".hmap");
+    if (!enabled_ || !std::filesystem::exists(filename))
+        return false;
+
+    try
+    {
+        heightmap = HeightmapFile(filename).readLevel(0);
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Warning: Ignoring cache entry: " << e.what()
+                  << std::endl;
+        return false;
+    }
+}
+
+bool GenerationCache::load(const CacheKey &key, Image2D &image) const
+{
+    std::string filename = path(key, ".img");
+    if (!enabled_)
+        return false;
+
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    std::streamoff file_size = file.tellg();
+    file.seekg(0);
+
+    char magic[4];
+    uint32_t format;
+    int32_t width, height;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&format), sizeof(format));
+    file.read(reinterpret_cast<char *>(&width), sizeof(width));
+    file.read(reinterpret_cast<char *>(&height), sizeof(height));
+
+    const size_t header_size = sizeof(magic) + 3 * sizeof(uint32_t);
+    size_t value_size =
+        format == static_cast<uint32_t>(PixelFormat::RGBA_FLOAT) ? 4 : 1;
+    if (!file || file_size < 0
+        || std::memcmp(magic, kImageMagic, sizeof(magic)) != 0
+        || format > static_cast<uint32_t>(PixelFormat::RGBA_8) || width < 0
+        || height < 0
+        || static_cast<size_t>(file_size)
+            != header_size + 4 * value_size * static_cast<size_t>(width) * height)
+    {
+        std::cerr << "Warning: Ignoring corrupted cache entry " << filename
+                  << std::endl;
+        return false;
+    }
+
+    // (read aside, image is left as is if the read fails)
+    Image2D loaded(width, height, static_cast<PixelFormat>(format));
+    if (loaded.format_ == PixelFormat::RGBA_FLOAT)
+        file.read(reinterpret_cast<char *>(loaded.pixels_.data()),
+                  loaded.pixels_.size() * sizeof(float));
+    else
+        file.read(reinterpret_cast<char *>(loaded.pixels_8_.data()),
+                  loaded.pixels_8_.size());
+
+    if (!file)
+    {
+        std::cerr << "Warning: Ignoring unreadable cache entry " << filename
+                  << std::endl;
+        return false;
+    }
+
+    image = std::move(loaded);
+    return true;
+}
+
+// Creates the directory and calls write(filename), errors become warnings
+static void store_file(const std::string &directory,
+                       const std::string &filename,
+                       const std::function<void(const std::string &)> &write)
+{
+    try
+    {
+        std::filesystem::create_directories(directory);
+        write(filename);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Warning: Unable to store cache entry " << filename
+                  << ": " << e.what() << std::endl;
+    }
+}
+
+void GenerationCache::store(const CacheKey &key,
+                            const Heightmap &heightmap) const
+{
+    if (!enabled_)
+        return;
+
+    store_file(directory_, path(key, ".hmap"),
+               [&heightmap](const std::string &filename) {
+                   // (written under a temporary name and renamed)
+                   HeightmapFile::write(filename, heightmap);
+               });
+}
+
+void GenerationCache::store(const CacheKey &key, const Image2D &image) const
+{
+    if (!enabled_)
+        return;
+
+    store_file(directory_, path(key, ".img"),
+               [&image](const std::string &filename) {
+                   std::ofstream file(filename + ".tmp", std::ios::binary);
+
+                   uint32_t format = static_cast<uint32_t>(image.format_);
+                   int32_t width = image.width_;
+                   int32_t height = image.height_;
+                   file.write(kImageMagic, sizeof(kImageMagic));
+                   file.write(reinterpret_cast<const char *>(&format),
+                              sizeof(format));
+                   file.write(reinterpret_cast<const char *>(&width),
+                              sizeof(width));
+                   file.write(reinterpret_cast<const char *>(&height),
+                              sizeof(height));
+
+                   if (image.format_ == PixelFormat::RGBA_FLOAT)
+                       file.write(
+                           reinterpret_cast<const char *>(image.pixels_.data()),
+                           image.pixels_.size() * sizeof(float));
+                   else
+                       file.write(reinterpret_cast<const char *>(
+                                      image.pixels_8_.data()),
+                                  image.pixels_8_.size());
+
+                   file.close();
+                   if (!file)
+                       throw std::runtime_error("write failed");
+                   std::filesystem::rename(filename + ".tmp", filename);
+               });
+}
+
+Heightmap
+GenerationCache::heightmap(const CacheKey &key,
+                           const std::function<Heightmap()> &generate) const
+{
+    Heightmap heightmap(0, 0);
+    if (load(key, heightmap))
+        return heightmap;
+
+    heightmap = generate();
+    store(key, heightmap);
+    return heightmap;
+}
+
+Image2D GenerationCache::image(const CacheKey &key,
+                               const std::function<Image2D()> &generate) const
+{
+    Image2D image;
+    if (load(key, image))
+        return image;
+
+    image = generate();
+    store(key, image);
+    return image;
+}
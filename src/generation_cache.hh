@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "color.hh"
+#include "heightmap.hh"
+#include "image2d.hh"
+#include "vector3.hh"
+
+// Hash (64 bit FNV-1a) of everything a generated map depends on: the
+// generator, its parameters and seed, and the contents of its inputs
+// (heightmaps, images, files).
+class CacheKey
+{
+public:
+    // kind names the generator and the version of its output (e.g.
+    // "normal_map/1"): bump the version when the generator changes
+    explicit CacheKey(const std::string &kind);
+
+    CacheKey &add(double value);
+    CacheKey &add(int value);
+    CacheKey &add(const std::string &value);
+    CacheKey &add(const Color &color);
+    CacheKey &add(const Vector3 &vector);
+    CacheKey &add(const Heightmap &heightmap); // size and heights
+    CacheKey &add(const Image2D &image); // size, format and pixels
+    CacheKey &add(const CacheKey &key);
+
+    // Contents of a file (a missing file is hashed as such)
+    CacheKey &add_file(const std::string &filename);
+
+    // 16 hexadecimal digits
+    std::string hex() const;
+
+private:
+    uint64_t hash_;
+
+    void add_bytes(const void *data, size_t size);
+};
+
+// Directory of generated maps, each one in a file named after its key.
+// Heightmaps are stored as HMAP v2 floats (memory mapped when loaded), images
+// as their raw pixel buffer. Files are written under a temporary name and
+// renamed, so an interrupted run never leaves a truncated entry.
+class GenerationCache
+{
+public:
+    bool enabled_; // when false, nothing is loaded nor stored
+
+    GenerationCache(const std::string &directory);
+
+    // Cache of the renderer, in images/cache/
+    static GenerationCache &shared();
+
+    // Where the entry of key is (or would be) stored
+    std::string path(const CacheKey &key, const std::string &extension) const;
+
+    // false if the entry is missing or unreadable (the map is left as is)
+    bool load(const CacheKey &key, Heightmap &heightmap) const;
+    bool load(const CacheKey &key, Image2D &image) const;
+
+    // Failures are only reported, the cache is never required
+    void store(const CacheKey &key, const Heightmap &heightmap) const;
+    void store(const CacheKey &key, const Image2D &image) const;
+
+    // The cached map, otherwise generate() (stored for the next runs)
+    Heightmap heightmap(const CacheKey &key,
+                        const std::function<Heightmap()> &generate) const;
+    Image2D image(const CacheKey &key,
+                  const std::function<Image2D()> &generate) const;
+
+private:
+    std::string directory_;
+};
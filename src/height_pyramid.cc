@@ -0,0 +1,102 @@
+#include "height_pyramid.hh"
+
+#include <algorithm>
+
+HeightPyramid::HeightPyramid()
+    : levels_()
+{}
+
+HeightPyramid::HeightPyramid(const Heightmap &heightmap)
+    : levels_()
+{
+    int cells_height = heightmap.height_ - 1;
+    int cells_width = heightmap.width_ - 1;
+    if (cells_height <= 0 || cells_width <= 0)
+        return;
+
+    Level base{ cells_height, cells_width,
+                std::vector<float>(cells_height * cells_width),
+                std::vector<float>(cells_height * cells_width) };
+
+    for (int y = 0; y < cells_height; y++)
+    {
+        for (int x = 0; x < cells_width; x++)
+        {
+            float top_left = heightmap.at(y, x);
+            float top_right = heightmap.at(y, x + 1);
+            float bot_left = heightmap.at(y + 1, x);
+            float bot_right = heightmap.at(y + 1, x + 1);
+
+            base.min_[y * cells_width + x] =
+                std::min({ top_left, top_right, bot_left, bot_right });
+            base.max_[y * cells_width + x] =
+                std::max({ top_left, top_right, bot_left, bot_right });
+        }
+    }
+    levels_.push_back(std::move(base));
+
+    while (levels_.back().height_ > 1 || levels_.back().width_ > 1)
+    {
+        const Level &below = levels_.back();
+        int height = (below.height_ + 1) / 2;
+        int width = (below.width_ + 1) / 2;
+        Level level{ height, width, std::vector<float>(height * width),
+                     std::vector<float>(height * width) };
+
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                float min = below.min_[(2 * y) * below.width_ + 2 * x];
+                float max = below.max_[(2 * y) * below.width_ + 2 * x];
+
+                for (int dy = 0; dy < 2; dy++)
+                {
+                    for (int dx = 0; dx < 2; dx++)
+                    {
+                        int by = 2 * y + dy;
+                        int bx = 2 * x + dx;
+                        if (by >= below.height_ || bx >= below.width_)
+                            continue;
+                        min = std::min(min, below.min_[by * below.width_ + bx]);
+                        max = std::max(max, below.max_[by * below.width_ + bx]);
+                    }
+                }
+
+                level.min_[y * width + x] = min;
+                level.max_[y * width + x] = max;
+            }
+        }
+
+        levels_.push_back(std::move(level));
+    }
+}
+
+bool HeightPyramid::empty() const
+{
+    return levels_.empty();
+}
+
+int HeightPyramid::top_level() const
+{
+    return static_cast<int>(levels_.size()) - 1;
+}
+
+float HeightPyramid::min_at(int level, int y, int x) const
+{
+    return levels_[level].min_[y * levels_[level].width_ + x];
+}
+
+float HeightPyramid::max_at(int level, int y, int x) const
+{
+    return levels_[level].max_[y * levels_[level].width_ + x];
+}
+
+void HeightPyramid::cell_range(int level, int y, int x, int &y0, int &y1,
+                               int &x0, int &x1) const
+{
+    y0 = y << level;
+    x0 = x << level;
+    y1 = std::min((y + 1) << level, levels_[0].height_);
+    x1 = std::min((x + 1) << level, levels_[0].width_);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "heightmap.hh"
+
+// Quadtree of min/max heights over the cells of a heightmap
+// Level 0 holds one entry per cell (2x2 block of heightmap values), each upper
+// level merges 2x2 nodes of the level below, up to a single root node
+class HeightPyramid
+{
+public:
+    struct Level
+    {
+        int height_; // number of nodes along y
+        int width_; // number of nodes along x
+        std::vector<float> min_;
+        std::vector<float> max_;
+    };
+
+    std::vector<Level> levels_;
+
+    HeightPyramid();
+    HeightPyramid(const Heightmap &heightmap);
+
+    bool empty() const;
+    int top_level() const;
+
+    float min_at(int level, int y, int x) const;
+    float max_at(int level, int y, int x) const;
+
+    // Cells covered by a node, the range is [y0, y1) x [x0, x1)
+    void cell_range(int level, int y, int x, int &y0, int &y1, int &x0,
+                    int &x1) const;
+};
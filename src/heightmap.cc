@@ -2,11 +2,200 @@
 
 #include <algorithm>
 #include <cmath>
-#include <fstream>
 
+#include "heightmap_file.hh"
 #include "image2d.hh"
 #include "ppm_parser.hh"
 
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define HEIGHTMAP_X86
+#endif
+
+// Row kernels of the bulk operations. The SIMD kernels perform the same
+// operations in the same order as the scalar ones (no fused multiply-add), so
+// all kernels agree bit for bit.
+struct RowKernels
+{
+    const char *name;
+    void (*min_max)(const float *row, int n, float &min, float &max);
+    void (*normalize)(float *row, int n, float min, float range);
+    int (*count_above)(const float *row, int n, float threshold);
+    void (*half_downsample)(const float *top, const float *bottom, float *out, int n); // n output values
+    void (*multiply)(const float *row, const float *factors, float row_factor, float *out, int n);
+};
+
+static void minMaxScalar(const float *row, int n, float &min, float &max)
+{
+    for (int x = 0; x < n; x++)
+    {
+        min = std::min(min, row[x]);
+        max = std::max(max, row[x]);
+    }
+}
+
+static void normalizeScalar(float *row, int n, float min, float range)
+{
+    for (int x = 0; x < n; x++)
+    {
+        row[x] = (row[x] - min) / range;
+    }
+}
+
+static int countAboveScalar(const float *row, int n, float threshold)
+{
+    int count = 0;
+    for (int x = 0; x < n; x++)
+    {
+        if (row[x] > threshold)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void halfDownsampleScalar(const float *top, const float *bottom, float *out, int n)
+{
+    for (int x = 0; x < n; x++)
+    {
+        out[x] = (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1]) / 4;
+    }
+}
+
+static void multiplyScalar(const float *row, const float *factors, float row_factor, float *out, int n)
+{
+    for (int x = 0; x < n; x++)
+    {
+        out[x] = row[x] * (row_factor * factors[x]);
+    }
+}
+
+#ifdef HEIGHTMAP_X86
+
+// Rows start on 32 byte boundaries (see Heightmap::stride_): the first 8 values
+// of a row are loaded with aligned loads, the tail (n % 8) with the scalar code
+
+__attribute__((target("avx2"))) static void
+minMaxAvx2(const float *row, int n, float &min, float &max)
+{
+    int x = 0;
+    if (n >= 8)
+    {
+        // min(a, b) = b unless a < b, like std::min(b, a) (no NaN in heightmaps)
+        __m256 v_min = _mm256_set1_ps(min);
+        __m256 v_max = _mm256_set1_ps(max);
+        for (; x + 8 <= n; x += 8)
+        {
+            __m256 v = _mm256_load_ps(row + x);
+            v_min = _mm256_min_ps(v, v_min);
+            v_max = _mm256_max_ps(v, v_max);
+        }
+
+        alignas(32) float mins[8], maxs[8];
+        _mm256_store_ps(mins, v_min);
+        _mm256_store_ps(maxs, v_max);
+        for (int i = 0; i < 8; i++)
+        {
+            min = std::min(min, mins[i]);
+            max = std::max(max, maxs[i]);
+        }
+    }
+    minMaxScalar(row + x, n - x, min, max);
+}
+
+__attribute__((target("avx2"))) static void
+normalizeAvx2(float *row, int n, float min, float range)
+{
+    const __m256 v_min = _mm256_set1_ps(min);
+    const __m256 v_range = _mm256_set1_ps(range);
+    int x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 v = _mm256_load_ps(row + x);
+        _mm256_store_ps(row + x, _mm256_div_ps(_mm256_sub_ps(v, v_min), v_range));
+    }
+    normalizeScalar(row + x, n - x, min, range);
+}
+
+__attribute__((target("avx2"))) static int
+countAboveAvx2(const float *row, int n, float threshold)
+{
+    const __m256 v_threshold = _mm256_set1_ps(threshold);
+    int count = 0;
+    int x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 above = _mm256_cmp_ps(_mm256_load_ps(row + x), v_threshold, _CMP_GT_OQ);
+        count += __builtin_popcount(_mm256_movemask_ps(above));
+    }
+    return count + countAboveScalar(row + x, n - x, threshold);
+}
+
+__attribute__((target("avx2"))) static void
+halfDownsampleAvx2(const float *top, const float *bottom, float *out, int n)
+{
+    const __m256 four = _mm256_set1_ps(4.0f);
+    int x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 top_0 = _mm256_load_ps(top + 2 * x);
+        __m256 top_1 = _mm256_load_ps(top + 2 * x + 8);
+        __m256 bottom_0 = _mm256_load_ps(bottom + 2 * x);
+        __m256 bottom_1 = _mm256_load_ps(bottom + 2 * x + 8);
+
+        // even and odd columns (shuffles work on 128 bit lanes, hence the permutes)
+        __m256 top_even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(top_0, top_1, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 top_odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(top_0, top_1, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 bottom_even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(bottom_0, bottom_1, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 bottom_odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(bottom_0, bottom_1, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(top_even, top_odd), bottom_even), bottom_odd);
+        _mm256_storeu_ps(out + x, _mm256_div_ps(sum, four));
+    }
+    halfDownsampleScalar(top + 2 * x, bottom + 2 * x, out + x, n - x);
+}
+
+__attribute__((target("avx2"))) static void
+multiplyAvx2(const float *row, const float *factors, float row_factor, float *out, int n)
+{
+    const __m256 v_row_factor = _mm256_set1_ps(row_factor);
+    int x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 factor = _mm256_mul_ps(v_row_factor, _mm256_loadu_ps(factors + x));
+        _mm256_store_ps(out + x, _mm256_mul_ps(_mm256_load_ps(row + x), factor));
+    }
+    multiplyScalar(row + x, factors + x, row_factor, out + x, n - x);
+}
+
+#endif
+
+static RowKernels selectKernels()
+{
+#ifdef HEIGHTMAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return { "avx2", minMaxAvx2, normalizeAvx2, countAboveAvx2, halfDownsampleAvx2, multiplyAvx2 };
+    }
+#endif
+    return { "scalar", minMaxScalar, normalizeScalar, countAboveScalar, halfDownsampleScalar, multiplyScalar };
+}
+
+static const RowKernels kernels_ = selectKernels();
+
+const char *Heightmap::kernelName()
+{
+    return kernels_.name;
+}
+
+// Rows padded to kRowAlignment floats
+static int rowStride(int width)
+{
+    return (width + Heightmap::kRowAlignment - 1) / Heightmap::kRowAlignment * Heightmap::kRowAlignment;
+}
+
 /**
  * @brief Create a heightmap with the given width and height.
  *
@@ -16,9 +205,9 @@
 Heightmap::Heightmap(int width, int height)
     : width_(width)
     , height_(height)
-{
-    height_map_ = array2D(height, std::vector<float>(width, 0.0f));
-}
+    , stride_(rowStride(width))
+    , data_(static_cast<size_t>(rowStride(width)) * height, 0.0f)
+{}
 
 /**
  * @brief Create a heightmap from an Image2D object.
@@ -26,16 +215,14 @@ Heightmap::Heightmap(int width, int height)
  * @param[in] img  Image2D object to create the heightmap from
  */
 Heightmap::Heightmap(Image2D &img)
-    : width_(img.width_)
-    , height_(img.height_)
+    : Heightmap(img.width_, img.height_)
 {
-    height_map_ = array2D(height_, std::vector<float>(width_, 0.0f));
-
     for (int y = 0; y < height_; y++)
     {
+        std::span<float> heights = row(y);
         for (int x = 0; x < width_; x++)
         {
-            height_map_[y][x] = img.getPixel(y, x).r_ + img.getPixel(y, x).g_
+            heights[x] = img.getPixel(y, x).r_ + img.getPixel(y, x).g_
                 + img.getPixel(y, x).b_ / 3;
         }
     }
@@ -56,29 +243,6 @@ Heightmap::Heightmap(const std::string &filename)
     *this = Heightmap(img);
 }
 
-/**
- * @brief Get the value of a pixel in the heightmap with bounds checking.
- *
- * @param[in] y  y coordinate of the pixel
- * @param[in] x  x coordinate of the pixel
- */
-float Heightmap::at(int y, int x) const
-{
-    return height_map_.at(y).at(x);
-}
-
-/**
- * @brief Set the value of a pixel in the heightmap.
- *
- * @param[in] y      y coordinate of the pixel
- * @param[in] x      x coordinate of the pixel
- * @param[in] value  value to set
- */
-void Heightmap::set(int y, int x, float value)
-{
-    height_map_[y][x] = value;
-}
-
 /**
  * @brief Normalize the heightmap values to [0, 1] using min-max normalization.   
  */
@@ -86,148 +250,73 @@ void Heightmap::minMaxNormalize() {
     float min = std::numeric_limits<float>::max();
     float max = std::numeric_limits<float>::min();
 
-    for (const auto& row : height_map_) {
-        for (float value : row) {
-            min = std::min(min, value);
-            max = std::max(max, value);
-        }
+    for (int y = 0; y < height_; y++) {
+        kernels_.min_max(row(y).data(), width_, min, max);
     }
 
-    for (auto& row : height_map_) {
-        for (float& value : row) {
-            value = (value - min) / (max - min);
-        }
+    for (int y = 0; y < height_; y++) {
+        kernels_.normalize(row(y).data(), width_, min, max - min);
     }
 }
 
 /**
- * @brief Encode a float value to a uint16_t. The float value is multiplied by 1000 to keep 3 digits of precision.
- *
- * @param[in] value  Float value to encode
- *
- * @return the encoded float value
- */
-uint16_t encodeFloat(float value) {
-    int32_t scaledValue = static_cast<int32_t>(value * 1000.0f);
-    return static_cast<uint16_t>(scaledValue);
-}
-
-/**
- * @brief Decode a uint16_t value to a float. The uint16_t value is divided by 1000 to restore the original value.
- *
- * @param[in] encoded  Encoded float value
- *
- * @return the decoded float value
- */
-float decodeFloat(uint16_t encoded) {
-    return static_cast<float>(encoded) / 1000.0f;
-}
-
-/**
- * @brief Write the heightmap to a HMAP file. The file format is as follows:
- * - 4 bytes: width of the heightmap (int)
- * - 4 bytes: height of the heightmap (int)
- * - width * height * 2 bytes: heightmap values scaled by 1000 (uint16_t)
+ * @brief Write the heightmap to a HMAP v2 file, as floats (see HeightmapFile for the format).
  *
  * @param[in] filename  Name of the file to write the heightmap to
  */
 void Heightmap::writeToFile(const std::string &filename) {
-    std::ofstream file(filename, std::ios::binary);
-    if (file.is_open()) {
-        file.write(reinterpret_cast<const char*>(&width_), sizeof(int));
-        file.write(reinterpret_cast<const char*>(&height_), sizeof(int));
-
-        for (const auto& row : height_map_) {
-            for (float value : row) {
-                uint16_t encoded = encodeFloat(value);
-                file.write(reinterpret_cast<const char*>(&encoded), sizeof(uint16_t));
-            }
-        }
-        file.close();
-    } else {
-        throw std::runtime_error("writeToFile: Unable to open file: " + filename);
-    }
+    HeightmapFile::write(filename, *this);
 }
 
 /**
- * @brief Read a heightmap from a HMAP file. The file format is as follows:
- * - 4 bytes: width of the heightmap (int)
- * - 4 bytes: height of the heightmap (int)
- * - width * height * 2 bytes: heightmap values scaled by 1000 (uint16_t)
+ * @brief Read a heightmap from a HMAP file (v2, or v1: width, height, values * 1000 as uint16_t).
+ * The file is memory mapped: see HeightmapFile to read its downsampled levels or its rows in place.
  *
  * @param[in] filename  Name of the file to read the heightmap from
  *
  * @return the read heightmap
  */
 Heightmap Heightmap::readFromFile(const std::string &filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (file.is_open()) {
-        int width, height;
-        file.read(reinterpret_cast<char*>(&width), sizeof(int));
-        file.read(reinterpret_cast<char*>(&height), sizeof(int));
-
-        Heightmap heightmap(width, height);
-
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                uint16_t encoded;
-                file.read(reinterpret_cast<char*>(&encoded), sizeof(uint16_t));
-                float value = decodeFloat(encoded);
-                heightmap.set(y, x, value);
-            }
-        }
-
-        file.close();
-        return heightmap;
-    } else {
-        throw std::runtime_error("readFromFile: Unable to open file: " + filename);
-    }
+    return HeightmapFile(filename).readLevel(0);
 }
 
 /**
  * @brief Return a new heightmap, which is the multiplication of the heightmap by a 2D gaussian distribution.
- * Works for square heightmaps (if width != height, the function will return a heightmap of dimension (width, width)).
+ * The gaussian is centered on the heightmap, with the same standard deviation along both axes.
  *
  * @param base_sigma  Standard deviation of the 2D gaussian
  */
 Heightmap Heightmap::multiplyByGaussian(float base_sigma)
 {
-    Heightmap new_heightmap = Heightmap(width_, width_);
-    Heightmap gaussian_heightmap = Heightmap(width_, width_);
+    Heightmap new_heightmap = Heightmap(width_, height_);
 
-    // Create a 2D gaussian distribution
+    // Create a 2D gaussian distribution, normalized to [0, 1] (1 at the center).
+    // It is separable: exp(-(x^2 + y^2) / 2s^2) = exp(-x^2 / 2s^2) * exp(-y^2 / 2s^2),
+    // so only one factor per column and per row is computed
 
-    auto gaussian = [](float x, float y, float sigma) {
-        return (1.0f / 2 * M_PIf * sigma * sigma) * std::exp(-(x * x + y * y) / (2 * sigma * sigma));
+    auto gaussian_1d = [](float x, float sigma) {
+        return std::exp(-(x * x) / (2 * sigma * sigma));
     };
 
-    for (int y = 0; y < width_; y++)
+    std::vector<float> column_factors(width_);
+    for (int x = 0; x < width_; x++)
     {
-        for (int x = 0; x < width_; x++)
-        {
-            float dx = x - width_ / 2.f;
-            float dy = y - width_ / 2.f;
-            float gaussian_value = gaussian(dx, dy, base_sigma);
-
-            // Normalize gaussian value to [0, 1]
-            gaussian_value = gaussian_value / (gaussian(0, 0, base_sigma));
-
-            // (if we need to keep more height from the original heightmap starting from the middle)
-            // Normalize to [0, a > 1] then clamp to [0, 1]
-            // float a = 2.0f;
-            // gaussian_value = std::clamp(gaussian_value * a, 0.0f, 1.0f);
+        column_factors[x] = gaussian_1d(x - width_ / 2.f, base_sigma);
+    }
 
-            gaussian_heightmap.set(y, x, gaussian_value);
+    // (if we need to keep more height from the original heightmap starting from the middle)
+    // Normalize to [0, a > 1] then clamp to [0, 1]
+    // float a = 2.0f;
+    // gaussian_value = std::clamp(gaussian_value * a, 0.0f, 1.0f);
 
-            float value = height_map_[y][x] * gaussian_value;
-            new_heightmap.set(y, x, value);
-        }
+    for (int y = 0; y < height_; y++)
+    {
+        float row_factor = gaussian_1d(y - height_ / 2.f, base_sigma);
+        kernels_.multiply(row(y).data(), column_factors.data(), row_factor, new_heightmap.row(y).data(), width_);
     }
 
     // for debug purposes
 
-    // Image2D gaussian_image = Image2D(gaussian_heightmap);
-    // gaussian_image.writePPM("gaussian.ppm", false);
     // Image2D new_image = Image2D(new_heightmap);
     // new_image.writePPM("flattened.ppm", false);
 
@@ -241,10 +330,21 @@ Heightmap Heightmap::multiplyByGaussian(float base_sigma)
  */
 bool Heightmap::areSidesFlat(float threshold)
 {
-    for (int i = 0; i < width_; i++)
+    if (width_ == 0 || height_ == 0)
+    {
+        return true;
+    }
+
+    for (int x = 0; x < width_; x++)
+    {
+        if (this->at(0, x) > threshold || this->at(height_ - 1, x) > threshold)
+        {
+            return false;
+        }
+    }
+    for (int y = 0; y < height_; y++)
     {
-        if (this->at(0, i) > threshold || this->at(width_ - 1, i) > threshold
-            || this->at(i, 0) > threshold || this->at(i, width_ - 1) > threshold)
+        if (this->at(y, 0) > threshold || this->at(y, width_ - 1) > threshold)
         {
             return false;
         }
@@ -261,7 +361,7 @@ bool Heightmap::areSidesFlat(float threshold)
 Heightmap Heightmap::flattenSides(float threshold)
 {
     Heightmap res_heightmap = *this;
-    float base_sigma = static_cast<float>(width_) / 2; // TODO refine starting sigma value
+    float base_sigma = static_cast<float>(std::max(width_, height_)) / 2; // TODO refine starting sigma value
 
     int debug_count = 0;
 
@@ -292,13 +392,7 @@ int Heightmap::getAmountAboveThreshold(float threshold)
 
     for (int y = 0; y < height_; y++)
     {
-        for (int x = 0; x < width_; x++)
-        {
-            if (height_map_[y][x] > threshold)
-            {
-                count++;
-            }
-        }
+        count += kernels_.count_above(row(y).data(), width_, threshold);
     }
 
     return count;
@@ -316,9 +410,7 @@ Heightmap Heightmap::squareHalfDownsample() {
     Heightmap half_downsampled = Heightmap(width_ / 2, height_ / 2);
 
     for (int y = 0; y < height_ / 2; y++) {
-        for (int x = 0; x < width_ / 2; x++) {
-            half_downsampled.set(y, x, (height_map_[2 * y][2 * x] + height_map_[2 * y][2 * x + 1] + height_map_[2 * y + 1][2 * x] + height_map_[2 * y + 1][2 * x + 1]) / 4);
-        }
+        kernels_.half_downsample(row(2 * y).data(), row(2 * y + 1).data(), half_downsampled.row(y).data(), width_ / 2);
     }
 
     return half_downsampled;
@@ -1,21 +1,30 @@
 #pragma once
 
 #include <cstddef>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include <limits>
 
+#include "utils.hh"
+
 class Image2D;
 
+// Heights are stored in a single buffer, row after row. Every row starts on a
+// 32 byte boundary (rows are padded to kRowAlignment floats), so that rows can
+// be processed with aligned SIMD loads.
+// at(), set() and row() are unchecked; build with -DHEIGHTMAP_CHECKED to get
+// std::out_of_range on invalid coordinates (debug).
 class Heightmap
 {
 public:
-    using array2D = std::vector<std::vector<float>>;
+    static constexpr int kRowAlignment = 8; // floats (32 bytes)
 
     int width_; // should be size_t :(
     int height_; // should be size_t :(
-    array2D height_map_;
+    int stride_; // floats between the starts of two rows (width_ rounded up to kRowAlignment)
 
     Heightmap(int width, int height);
 
@@ -23,8 +32,30 @@ public:
 
     Heightmap(const std::string &filename);
 
-    float at(int y, int x) const;
-    void set(int y, int x, float value);
+    float at(int y, int x) const
+    {
+        checkBounds(y, x);
+        return data_[static_cast<size_t>(y) * stride_ + x];
+    }
+
+    void set(int y, int x, float value)
+    {
+        checkBounds(y, x);
+        data_[static_cast<size_t>(y) * stride_ + x] = value;
+    }
+
+    // View of the width_ values of a row
+    std::span<float> row(int y)
+    {
+        checkBounds(y, 0);
+        return { data_.data() + static_cast<size_t>(y) * stride_, static_cast<size_t>(width_) };
+    }
+
+    std::span<const float> row(int y) const
+    {
+        checkBounds(y, 0);
+        return { data_.data() + static_cast<size_t>(y) * stride_, static_cast<size_t>(width_) };
+    }
 
     void minMaxNormalize();
 
@@ -40,4 +71,24 @@ public:
 
     Heightmap squareHalfDownsample();
     Heightmap squareDownsample(int width_threshold);
-};
\ No newline at end of file
+
+    // Name of the kernel used on this CPU by the row operations
+    static const char *kernelName();
+
+private:
+    std::vector<float, utils::AlignedAllocator<float, 32>> data_; // height_ rows of stride_ floats (padding is 0)
+
+#ifdef HEIGHTMAP_CHECKED
+    void checkBounds(int y, int x) const
+    {
+        if (y < 0 || y >= height_ || x < 0 || (x >= width_ && !(x == 0 && width_ == 0)))
+        {
+            throw std::out_of_range("Heightmap: (" + std::to_string(y) + ", " + std::to_string(x) + ") is out of a "
+                                    + std::to_string(width_) + "x" + std::to_string(height_) + " heightmap");
+        }
+    }
+#else
+    void checkBounds(int, int) const
+    {}
+#endif
+};
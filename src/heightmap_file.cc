@@ -0,0 +1,459 @@
+#include "heightmap_file.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kMagic[4] = { 'H', 'M', 'A', 'P' };
+static constexpr size_t kHeaderSize = 32;
+static constexpr size_t kLevelEntrySize = 24;
+
+static size_t sampleSize(HeightmapSampleType sample_type)
+{
+    return sample_type == HeightmapSampleType::F32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+// Round to nearest even, like the F16C instructions
+static uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) // infinity or NaN
+    {
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+    if (exponent >= 31) // too large
+    {
+        return sign | 0x7C00;
+    }
+
+    if (exponent <= 0) // subnormal half (or 0)
+    {
+        if (exponent < -10)
+        {
+            return sign;
+        }
+
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+        {
+            half++;
+        }
+        return sign | half;
+    }
+
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+    {
+        half++; // (a carry into the exponent is still the right rounding)
+    }
+    return half;
+}
+
+static float halfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Map a HMAP file (v1 or v2) in memory.
+ *
+ * @param[in] filename  HMAP file
+ */
+HeightmapFile::HeightmapFile(const std::string &filename)
+    : filename_(filename)
+    , data_(nullptr)
+    , size_(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("HeightmapFile: Unable to open file: " + filename);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < 8)
+    {
+        close(fd);
+        throw std::runtime_error("HeightmapFile: Not a HMAP file: " + filename);
+    }
+
+    size_ = file_stat.st_size;
+    void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // (the mapping stays valid)
+
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("HeightmapFile: Unable to map file: " + filename);
+    }
+    data_ = static_cast<const unsigned char *>(mapping);
+
+    try
+    {
+        parseHeader();
+    }
+    catch (...)
+    {
+        munmap(const_cast<unsigned char *>(data_), size_);
+        throw;
+    }
+}
+
+HeightmapFile::~HeightmapFile()
+{
+    munmap(const_cast<unsigned char *>(data_), size_);
+}
+
+void HeightmapFile::parseHeader()
+{
+    auto read_u32 = [this](size_t offset) {
+        uint32_t value;
+        std::memcpy(&value, data_ + offset, sizeof(value));
+        return value;
+    };
+
+    if (!std::equal(kMagic, kMagic + sizeof(kMagic), data_))
+    {
+        // v1: bare width and height, then the values
+        version_ = 1;
+        sample_type_ = HeightmapSampleType::U16_MILLI;
+        range_min_ = 0.0f;
+        range_max_ = 65.535f;
+
+        int width = static_cast<int>(read_u32(0));
+        int height = static_cast<int>(read_u32(4));
+        if (width < 0 || height < 0 || 8 + static_cast<uint64_t>(width) * height * sizeof(uint16_t) > size_)
+        {
+            throw std::runtime_error("HeightmapFile: Truncated HMAP v1 file: " + filename_);
+        }
+
+        levels_.push_back({ width, height, width, 8 });
+        return;
+    }
+
+    if (size_ < kHeaderSize)
+    {
+        throw std::runtime_error("HeightmapFile: Truncated HMAP file: " + filename_);
+    }
+
+    version_ = read_u32(4);
+    if (version_ != static_cast<int>(kVersion))
+    {
+        throw std::runtime_error("HeightmapFile: Unsupported HMAP version " + std::to_string(version_) + ": " + filename_);
+    }
+
+    sample_type_ = static_cast<HeightmapSampleType>(read_u32(8));
+    if (sample_type_ != HeightmapSampleType::U16_NORM && sample_type_ != HeightmapSampleType::F16
+        && sample_type_ != HeightmapSampleType::F32)
+    {
+        throw std::runtime_error("HeightmapFile: Unknown sample type: " + filename_);
+    }
+
+    uint32_t level_count = read_u32(12);
+    std::memcpy(&range_min_, data_ + 16, sizeof(float));
+    std::memcpy(&range_max_, data_ + 20, sizeof(float));
+
+    if (kHeaderSize + static_cast<uint64_t>(level_count) * kLevelEntrySize > size_)
+    {
+        throw std::runtime_error("HeightmapFile: Truncated HMAP file: " + filename_);
+    }
+
+    for (uint32_t i = 0; i < level_count; i++)
+    {
+        size_t entry = kHeaderSize + i * kLevelEntrySize;
+        Level level;
+        level.width = static_cast<int>(read_u32(entry));
+        level.height = static_cast<int>(read_u32(entry + 4));
+        level.stride = static_cast<int>(read_u32(entry + 8));
+        std::memcpy(&level.offset, data_ + entry + 16, sizeof(uint64_t));
+
+        // (sizes are checked without adding to the offset, which could overflow)
+        uint64_t payload_size = static_cast<uint64_t>(level.stride) * level.height * sampleSize(sample_type_);
+        if (level.width < 0 || level.height < 0 || level.stride < level.width || level.offset % kPageSize != 0
+            || level.offset > size_ || payload_size > size_ - level.offset)
+        {
+            throw std::runtime_error("HeightmapFile: Corrupted HMAP level " + std::to_string(i) + ": " + filename_);
+        }
+
+        // floatRow() hands out aligned rows
+        if (sample_type_ == HeightmapSampleType::F32 && level.stride % Heightmap::kRowAlignment != 0)
+        {
+            throw std::runtime_error("HeightmapFile: Misaligned rows in HMAP level " + std::to_string(i) + ": " + filename_);
+        }
+
+        levels_.push_back(level);
+    }
+}
+
+int HeightmapFile::version() const
+{
+    return version_;
+}
+
+HeightmapSampleType HeightmapFile::sampleType() const
+{
+    return sample_type_;
+}
+
+float HeightmapFile::rangeMin() const
+{
+    return range_min_;
+}
+
+float HeightmapFile::rangeMax() const
+{
+    return range_max_;
+}
+
+int HeightmapFile::levelCount() const
+{
+    return levels_.size();
+}
+
+const HeightmapFile::Level &HeightmapFile::level(int index) const
+{
+    return levels_.at(index);
+}
+
+int HeightmapFile::findLevel(int max_width) const
+{
+    int found = -1;
+    for (int i = 0; i < levelCount(); i++)
+    {
+        if (levels_[i].width <= max_width && (found == -1 || levels_[i].width > levels_[found].width))
+        {
+            found = i;
+        }
+    }
+    return found;
+}
+
+std::span<const float> HeightmapFile::floatRow(int level, int y) const
+{
+    const Level &l = levels_.at(level);
+    if (sample_type_ != HeightmapSampleType::F32)
+    {
+        throw std::runtime_error("HeightmapFile: floatRow: Samples are not floats: " + filename_);
+    }
+    if (y < 0 || y >= l.height)
+    {
+        throw std::out_of_range("HeightmapFile: floatRow: Row " + std::to_string(y) + " is out of level " + std::to_string(level));
+    }
+
+    // payloads are page aligned and strides are multiples of Heightmap::kRowAlignment: rows are aligned floats
+    const float *rows = reinterpret_cast<const float *>(data_ + l.offset);
+    return { rows + static_cast<size_t>(y) * l.stride, static_cast<size_t>(l.width) };
+}
+
+/**
+ * @brief Decode a level of the file.
+ *
+ * @param[in] level  level index (0 for the full heightmap)
+ *
+ * @return the heightmap of the level
+ */
+Heightmap HeightmapFile::readLevel(int level) const
+{
+    const Level &l = levels_.at(level);
+    Heightmap heightmap(l.width, l.height);
+
+    const unsigned char *payload = data_ + l.offset;
+    const size_t row_bytes = static_cast<size_t>(l.stride) * sampleSize(sample_type_);
+    const float scale = (range_max_ - range_min_) / 65535.0f;
+
+    // (v1 payloads are not aligned, 16 bit rows are copied first)
+    std::vector<uint16_t> samples(sample_type_ == HeightmapSampleType::F32 ? 0 : l.width);
+
+    for (int y = 0; y < l.height; y++)
+    {
+        std::span<float> row = heightmap.row(y);
+        const unsigned char *source = payload + y * row_bytes;
+
+        if (sample_type_ == HeightmapSampleType::F32)
+        {
+            std::memcpy(row.data(), source, l.width * sizeof(float));
+            continue;
+        }
+
+        std::memcpy(samples.data(), source, l.width * sizeof(uint16_t));
+
+        for (int x = 0; x < l.width; x++)
+        {
+            switch (sample_type_)
+            {
+            case HeightmapSampleType::U16_NORM:
+                row[x] = range_min_ + samples[x] * scale;
+                break;
+            case HeightmapSampleType::F16:
+                row[x] = halfToFloat(samples[x]);
+                break;
+            default: // U16_MILLI
+                row[x] = static_cast<float>(samples[x]) / 1000.0f;
+                break;
+            }
+        }
+    }
+
+    return heightmap;
+}
+
+/**
+ * @brief Write a heightmap to a HMAP v2 file.
+ *
+ * @param[in] filename         name of the file to write
+ * @param[in] heightmap        heightmap to write (level 0)
+ * @param[in] sample_type      how to store the samples (not U16_MILLI)
+ * @param[in] min_level_width  smallest level of the pyramid (square heightmaps only), 0 for level 0 only
+ */
+void HeightmapFile::write(const std::string &filename, const Heightmap &heightmap,
+                          HeightmapSampleType sample_type, int min_level_width)
+{
+    if (sample_type == HeightmapSampleType::U16_MILLI)
+    {
+        throw std::runtime_error("HeightmapFile: write: U16_MILLI is only read (HMAP v1)");
+    }
+
+    std::vector<Heightmap> levels = { heightmap };
+    while (min_level_width > 0 && levels.back().width_ == levels.back().height_
+           && levels.back().width_ % 2 == 0 && levels.back().width_ / 2 >= min_level_width)
+    {
+        levels.push_back(levels.back().squareHalfDownsample());
+    }
+
+    float range_min = 0.0f;
+    float range_max = 0.0f;
+    bool empty = true;
+    for (int y = 0; y < heightmap.height_; y++)
+    {
+        for (float value : heightmap.row(y))
+        {
+            range_min = empty ? value : std::min(range_min, value);
+            range_max = empty ? value : std::max(range_max, value);
+            empty = false;
+        }
+    }
+    const float range = range_max - range_min;
+
+    std::ofstream file(filename + ".tmp", std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("HeightmapFile: write: Unable to open file: " + filename + ".tmp");
+    }
+
+    // header and level table
+    std::vector<unsigned char> header(kHeaderSize + levels.size() * kLevelEntrySize, 0);
+    auto put = [&header](size_t offset, const auto &value) {
+        std::memcpy(header.data() + offset, &value, sizeof(value));
+    };
+
+    put(0, kMagic);
+    put(4, kVersion);
+    put(8, static_cast<uint32_t>(sample_type));
+    put(12, static_cast<uint32_t>(levels.size()));
+    put(16, range_min);
+    put(20, range_max);
+
+    uint64_t offset = (header.size() + kPageSize - 1) / kPageSize * kPageSize;
+    std::vector<uint64_t> offsets;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const Heightmap &level = levels[i];
+        size_t entry = kHeaderSize + i * kLevelEntrySize;
+        put(entry, static_cast<uint32_t>(level.width_));
+        put(entry + 4, static_cast<uint32_t>(level.height_));
+        put(entry + 8, static_cast<uint32_t>(level.stride_));
+        put(entry + 16, offset);
+
+        offsets.push_back(offset);
+        offset += static_cast<uint64_t>(level.stride_) * level.height_ * sampleSize(sample_type);
+        offset = (offset + kPageSize - 1) / kPageSize * kPageSize;
+    }
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+
+    // payloads, one row at a time (padding is written as 0)
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const Heightmap &level = levels[i];
+        std::vector<char> row_bytes(static_cast<size_t>(level.stride_) * sampleSize(sample_type), 0);
+
+        const std::vector<char> padding(offsets[i] - file.tellp(), 0);
+        file.write(padding.data(), padding.size());
+
+        for (int y = 0; y < level.height_; y++)
+        {
+            std::span<const float> row = level.row(y);
+
+            if (sample_type == HeightmapSampleType::F32)
+            {
+                std::memcpy(row_bytes.data(), row.data(), row.size() * sizeof(float));
+            }
+            else
+            {
+                for (int x = 0; x < level.width_; x++)
+                {
+                    uint16_t sample;
+                    if (sample_type == HeightmapSampleType::F16)
+                    {
+                        sample = floatToHalf(row[x]);
+                    }
+                    else
+                    {
+                        sample = range > 0 ? std::lround(std::clamp((row[x] - range_min) / range, 0.0f, 1.0f) * 65535.0f) : 0;
+                    }
+                    std::memcpy(row_bytes.data() + x * sizeof(uint16_t), &sample, sizeof(sample));
+                }
+            }
+
+            file.write(row_bytes.data(), row_bytes.size());
+        }
+    }
+
+    file.close();
+    if (!file)
+    {
+        throw std::runtime_error("HeightmapFile: write: Unable to write file: " + filename + ".tmp");
+    }
+
+    // (readers mapping the previous file keep their mapping)
+    if (std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0)
+    {
+        throw std::runtime_error("HeightmapFile: write: Unable to rename " + filename + ".tmp to " + filename);
+    }
+}
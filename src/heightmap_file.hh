@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "heightmap.hh"
+
+// How the samples of a HMAP file are stored
+enum class HeightmapSampleType : uint32_t
+{
+    U16_NORM = 0, // 16 bit unsigned, mapped linearly to [range_min, range_max]
+    F16 = 1, // IEEE half float
+    F32 = 2, // IEEE float, rows padded like Heightmap rows (readable in place)
+    U16_MILLI = 3, // HMAP v1 only: 16 bit unsigned, value * 1000 (wraps above 65.535)
+};
+
+// Read-only memory mapping of a HMAP file.
+//
+// HMAP v2 layout (machine byte order):
+// - header: "HMAP", version (uint32 = 2), sample type (uint32), level count
+//   (uint32), range_min and range_max (float), 8 reserved bytes
+// - one entry per level: width, height, stride (samples between the starts of
+//   two rows), reserved (uint32 each), payload offset (uint64)
+// - level payloads, each starting on a kPageSize boundary
+// Level 0 is the full heightmap, the next levels (mip pyramid) are each
+// Heightmap::squareHalfDownsample() of the previous one.
+//
+// HMAP v1 files (width, height, values * 1000 as uint16) are read as a single
+// U16_MILLI level.
+class HeightmapFile
+{
+public:
+    static constexpr size_t kPageSize = 4096;
+    static constexpr uint32_t kVersion = 2;
+
+    struct Level
+    {
+        int width;
+        int height;
+        int stride; // samples
+        uint64_t offset; // bytes from the start of the file
+    };
+
+    HeightmapFile(const std::string &filename);
+    ~HeightmapFile();
+
+    HeightmapFile(const HeightmapFile &) = delete;
+    HeightmapFile &operator=(const HeightmapFile &) = delete;
+
+    int version() const;
+    HeightmapSampleType sampleType() const;
+    float rangeMin() const;
+    float rangeMax() const;
+
+    int levelCount() const;
+    const Level &level(int index) const;
+
+    // Index of the largest level whose width is <= max_width, -1 if none
+    int findLevel(int max_width) const;
+
+    // Row of an F32 level, read in place from the mapping (no copy)
+    std::span<const float> floatRow(int level, int y) const;
+
+    // Decode a level (a copy of the mapped rows for F32)
+    Heightmap readLevel(int level) const;
+
+    // Write a HMAP v2 file, with the downsampled levels of square heightmaps
+    // down to min_level_width (no pyramid if the heightmap is smaller)
+    static void write(const std::string &filename, const Heightmap &heightmap,
+                      HeightmapSampleType sample_type = HeightmapSampleType::F32,
+                      int min_level_width = 0);
+
+private:
+    std::string filename_;
+    const unsigned char *data_; // mapping of the whole file
+    size_t size_;
+
+    int version_;
+    HeightmapSampleType sample_type_;
+    float range_min_;
+    float range_max_;
+    std::vector<Level> levels_;
+
+    void parseHeader();
+};
@@ -0,0 +1,385 @@
+#include "horizon_map.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hh"
+#include "utils.hh"
+
+// Well above the kEpsilon offset of shadow ray origins, in local units for
+// heights and in scaled height per grid unit for slopes
+static constexpr double kHorizonTolerance = 1e-3;
+
+// Cell of the triangle mesh built by Terrain::create_mesh around a point:
+// its corner heights and the position of the point inside it
+struct MeshCell
+{
+    double top_left;
+    double top_right;
+    double bot_left;
+    double bot_right;
+    double fx;
+    double fy;
+
+    MeshCell(const Heightmap &heightmap, double y, double x)
+    {
+        x = std::clamp(x, 0.0, heightmap.width_ - 1.0);
+        y = std::clamp(y, 0.0, heightmap.height_ - 1.0);
+
+        int x0 = std::min(static_cast<int>(x), heightmap.width_ - 2);
+        int y0 = std::min(static_cast<int>(y), heightmap.height_ - 2);
+        fx = x - x0;
+        fy = y - y0;
+
+        top_left = heightmap.at(y0, x0);
+        top_right = heightmap.at(y0, x0 + 1);
+        bot_left = heightmap.at(y0 + 1, x0);
+        bot_right = heightmap.at(y0 + 1, x0 + 1);
+    }
+
+    // Cells are split along the top right to bottom left diagonal
+    bool upper() const
+    {
+        return fx + fy <= 1.0;
+    }
+
+    double height() const
+    {
+        if (upper())
+            return top_left + fx * (top_right - top_left)
+                + fy * (bot_left - top_left);
+
+        return bot_right + (1.0 - fx) * (bot_left - bot_right)
+            + (1.0 - fy) * (top_right - bot_right);
+    }
+
+    // Height variation of the triangle per grid unit along (dir_y, dir_x)
+    double slope(double dir_y, double dir_x) const
+    {
+        if (upper())
+            return dir_x * (top_right - top_left)
+                + dir_y * (bot_left - top_left);
+
+        return dir_x * (bot_right - bot_left) + dir_y * (bot_right - top_right);
+    }
+};
+
+// Height of the triangle mesh built by Terrain::create_mesh at a point
+static double mesh_height_at(const Heightmap &heightmap, double y, double x)
+{
+    return MeshCell(heightmap, y, x).height();
+}
+
+// Horizontal distance to the next integer value of a coordinate moving at
+// speed dir
+static double next_crossing(double coord, double dir)
+{
+    if (std::fabs(dir) < utils::kEpsilon)
+        return utils::infinity;
+    if (dir > 0)
+        return (std::floor(coord) + 1.0 - coord) / dir;
+    return (coord - (std::ceil(coord) - 1.0)) / -dir;
+}
+
+/**
+ * @brief Walk from (y, x) towards the light along its azimuth.
+ *
+ * The mesh height along a horizontal line is piecewise linear, with breaks
+ * where the line crosses grid lines or cell diagonals, so visiting these
+ * crossings is exact. visit(s, height) receives the horizontal distance in
+ * grid units and the scaled mesh height there, and returns false to stop.
+ * The walk also stops when leaving the grid.
+ */
+template <typename Visit>
+static void march(const Heightmap &heightmap, double dir_x, double dir_y,
+                  double y, double x, Visit visit)
+{
+    double next_x = next_crossing(x, dir_x);
+    double next_y = next_crossing(y, dir_y);
+    double next_diag = next_crossing(x + y, dir_x + dir_y);
+    double step_x = next_crossing(0, dir_x);
+    double step_y = next_crossing(0, dir_y);
+    double step_diag = next_crossing(0, dir_x + dir_y);
+
+    while (true)
+    {
+        double s = std::min({ next_x, next_y, next_diag });
+        if (s == utils::infinity)
+            return;
+        if (s == next_x)
+            next_x += step_x;
+        if (s == next_y)
+            next_y += step_y;
+        if (s == next_diag)
+            next_diag += step_diag;
+
+        double qx = x + s * dir_x;
+        double qy = y + s * dir_y;
+        if (qx < -utils::kEpsilon || qx > heightmap.width_ - 1 + utils::kEpsilon
+            || qy < -utils::kEpsilon
+            || qy > heightmap.height_ - 1 + utils::kEpsilon)
+            return;
+
+        if (!visit(s, mesh_height_at(heightmap, qy, qx)))
+            return;
+    }
+}
+
+HorizonMap::HorizonMap(std::shared_ptr<Heightmap> heightmap, float xy_scale,
+                       float height_scale, const Vector3 &light_dir)
+    : heightmap_(heightmap)
+    , light_dir_(Vector3::unit_vector(light_dir))
+    , xy_scale_(xy_scale)
+    , height_scale_(height_scale)
+    , horizon_slopes_(heightmap->width_, heightmap->height_)
+    , shadow_heights_(heightmap->width_, heightmap->height_)
+{
+    float min_height = heightmap->at(0, 0);
+    float max_height = heightmap->at(0, 0);
+    for (int y = 0; y < heightmap->height_; y++)
+    {
+        for (int x = 0; x < heightmap->width_; x++)
+        {
+            min_height = std::min(min_height, heightmap->at(y, x));
+            max_height = std::max(max_height, heightmap->at(y, x));
+        }
+    }
+    max_height_ = height_scale_ * max_height;
+
+    // Samples with nothing in front of them get a height below the whole
+    // terrain
+    float no_shadow = height_scale_ * min_height - 1.0f;
+
+    double horizontal = std::sqrt(light_dir_.x_ * light_dir_.x_
+                                  + light_dir_.z_ * light_dir_.z_);
+    if (horizontal < utils::kEpsilon || light_dir_.y_ <= 0)
+    {
+        // Nothing to sweep, every sample is lit
+        light_slope_ = utils::infinity;
+        for (int y = 0; y < heightmap->height_; y++)
+        {
+            for (int x = 0; x < heightmap->width_; x++)
+            {
+                horizon_slopes_.set(y, x, std::numeric_limits<float>::lowest());
+                shadow_heights_.set(y, x, no_shadow);
+            }
+        }
+        return;
+    }
+
+    light_slope_ = xy_scale_ * light_dir_.y_ / horizontal;
+    sweep(no_shadow);
+}
+
+/**
+ * @brief Compute both maps along parallel lines following the light azimuth.
+ *
+ * The lines step one sample at a time along the major axis of the azimuth
+ * and are one sample apart on the other axis, where the mesh height is read
+ * on the grid line. Each line is walked away from the light keeping the upper
+ * convex hull of the profile already walked, whose tangent from a point is
+ * its horizon, and the running maximum of height - light_slope * distance,
+ * which gives its shadow height: O(1) amortized per point. Samples
+ * interpolate the two lines around them. Lines are independent and swept in
+ * parallel.
+ */
+void HorizonMap::sweep(float no_shadow)
+{
+    const Heightmap &heightmap = *heightmap_;
+    double horizontal = std::sqrt(light_dir_.x_ * light_dir_.x_
+                                  + light_dir_.z_ * light_dir_.z_);
+    double dir_x = light_dir_.x_ / horizontal;
+    double dir_y = light_dir_.z_ / horizontal;
+
+    // Lines are indexed along the minor axis, points along the major one
+    bool major_x = std::fabs(dir_x) >= std::fabs(dir_y);
+    int major_size = major_x ? heightmap.width_ : heightmap.height_;
+    int minor_size = major_x ? heightmap.height_ : heightmap.width_;
+    double major_dir = major_x ? dir_x : dir_y;
+    int toward_light = major_dir > 0 ? 1 : -1;
+    // Minor coordinate of line c at major coordinate i: c + shift * i
+    double shift = (major_x ? dir_y : dir_x) / std::fabs(major_dir);
+    double step = std::sqrt(1.0 + shift * shift); // between two points
+
+    double end_shift = shift * (major_size - 1);
+    int first_line = static_cast<int>(std::floor(std::min(0.0, -end_shift)));
+    int last_line =
+        static_cast<int>(std::ceil(minor_size - 1 - std::min(0.0, end_shift)));
+    int line_count = last_line - first_line + 1;
+
+    size_t line_points = static_cast<size_t>(line_count) * major_size;
+    std::vector<float> line_slopes(line_points);
+    std::vector<float> line_shadows(line_points);
+
+    ThreadPool::shared().parallel_for(
+        0, line_count, 16, [&](int line_begin, int line_end) {
+            // Upper hull of the profile already walked: (distance, height)
+            std::vector<std::pair<double, double>> hull;
+
+            for (int line = line_begin; line < line_end; line++)
+            {
+                hull.clear();
+                double best = -utils::infinity; // max of height - slope * t
+
+                for (int k = 0; k < major_size; k++)
+                {
+                    int i = toward_light > 0 ? major_size - 1 - k : k;
+                    double minor = first_line + line + shift * i;
+                    // Distance towards the light
+                    double t = toward_light * i * step;
+
+                    double height = height_scale_
+                        * (major_x ? mesh_height_at(heightmap, minor, i)
+                                   : mesh_height_at(heightmap, i, minor));
+
+                    auto slope_to = [&](const std::pair<double, double> &q) {
+                        return (q.second - height) / (q.first - t);
+                    };
+                    while (hull.size() >= 2
+                           && slope_to(hull.back())
+                               <= slope_to(hull[hull.size() - 2]))
+                        hull.pop_back();
+
+                    size_t index = static_cast<size_t>(line) * major_size + i;
+                    line_slopes[index] = hull.empty()
+                        ? std::numeric_limits<float>::lowest()
+                        : slope_to(hull.back());
+                    line_shadows[index] =
+                        std::max<double>(no_shadow, best + light_slope_ * t);
+
+                    // Points off the grid are only interpolated, they never
+                    // occlude
+                    if (minor <= -1.0 || minor >= minor_size)
+                        continue;
+                    hull.emplace_back(t, height);
+                    best = std::max(best, height - light_slope_ * t);
+                }
+            }
+        });
+
+    ThreadPool::shared().parallel_for(
+        0, heightmap.height_, 16, [&](int row_begin, int row_end) {
+            for (int y = row_begin; y < row_end; y++)
+            {
+                for (int x = 0; x < heightmap.width_; x++)
+                {
+                    int i = major_x ? x : y;
+                    double c = (major_x ? y : x) - shift * i - first_line;
+                    int line = std::min(static_cast<int>(c), line_count - 2);
+                    double f = c - line;
+
+                    size_t above = static_cast<size_t>(line) * major_size + i;
+                    size_t below = above + major_size;
+                    horizon_slopes_.set(y, x,
+                                        (1 - f) * line_slopes[above]
+                                            + f * line_slopes[below]);
+                    shadow_heights_.set(y, x,
+                                        (1 - f) * line_shadows[above]
+                                            + f * line_shadows[below]);
+                }
+            }
+        });
+}
+
+bool HorizonMap::matches(const Vector3 &light_dir) const
+{
+    return Vector3::dot(light_dir_, Vector3::unit_vector(light_dir))
+        > 1 - utils::kEpsilon;
+}
+
+// Corners of the cell of a map around a point
+static void cell_range(const Heightmap &map, double y, double x, double &min,
+                       double &max)
+{
+    int x0 = std::clamp(static_cast<int>(x), 0, map.width_ - 1);
+    int y0 = std::clamp(static_cast<int>(y), 0, map.height_ - 1);
+    int x1 = std::min(x0 + 1, map.width_ - 1);
+    int y1 = std::min(y0 + 1, map.height_ - 1);
+
+    float corners[4] = { map.at(y0, x0), map.at(y0, x1), map.at(y1, x0),
+                         map.at(y1, x1) };
+    min = *std::min_element(corners, corners + 4);
+    max = *std::max_element(corners, corners + 4);
+}
+
+bool HorizonMap::is_shadowed(double y, double x, double height) const
+{
+    if (light_slope_ == utils::infinity)
+        return false;
+
+    double min;
+    double max;
+
+    // Shading points lie on the mesh (shadow rays start kEpsilon away from
+    // it): the light elevation is compared with the horizon there, unless
+    // their triangle faces away from the light. The ray then goes under the
+    // one sided mesh, only the march can tell where it leaves it
+    MeshCell cell(*heightmap_, y, x);
+    double surface = height_scale_ * cell.height();
+    if (std::fabs(height - surface) <= kHorizonTolerance)
+    {
+        double horizontal = std::sqrt(light_dir_.x_ * light_dir_.x_
+                                      + light_dir_.z_ * light_dir_.z_);
+        double surface_slope = height_scale_
+            * cell.slope(light_dir_.z_ / horizontal,
+                         light_dir_.x_ / horizontal);
+        if (surface_slope > light_slope_ - kHorizonTolerance)
+            return is_occluded(y, x, height);
+
+        cell_range(horizon_slopes_, y, x, min, max);
+        if (light_slope_ > max + kHorizonTolerance)
+            return false;
+        if (light_slope_ < min - kHorizonTolerance)
+            return true;
+        return is_occluded(y, x, height);
+    }
+
+    // Other points (e.g. on the ocean) are compared with the shadow heights,
+    // points below the mesh need the march to honour one sided triangles
+    if (height > surface)
+    {
+        cell_range(shadow_heights_, y, x, min, max);
+        if (height > max + kHorizonTolerance)
+            return false;
+        if (height < min - kHorizonTolerance)
+            return true;
+    }
+
+    return is_occluded(y, x, height);
+}
+
+// Mesh triangles are one sided: a ray starting below the mesh leaves it
+// without a hit, only entering the mesh from above again occludes it
+bool HorizonMap::is_occluded(double y, double x, double height) const
+{
+    double horizontal = std::sqrt(light_dir_.x_ * light_dir_.x_
+                                  + light_dir_.z_ * light_dir_.z_);
+    if (horizontal < utils::kEpsilon || light_dir_.y_ <= 0)
+        return false;
+
+    double rise = xy_scale_ * light_dir_.y_ / horizontal;
+    // Shading points lie on the mesh, a start within epsilon of it counts as
+    // below so that its own triangle never occludes it, as with a ray
+    bool below = height_scale_ * mesh_height_at(*heightmap_, y, x)
+            + utils::kEpsilon
+        >= height;
+    bool occluded = false;
+
+    march(*heightmap_, light_dir_.x_ / horizontal, light_dir_.z_ / horizontal,
+          y, x, [&](double s, double mesh_height) {
+              double ray_height = height + rise * s;
+              bool now_below = height_scale_ * mesh_height >= ray_height;
+              if (now_below && !below)
+              {
+                  occluded = true;
+                  return false;
+              }
+              below = now_below;
+              return below || max_height_ > ray_height;
+          });
+
+    return occluded;
+}
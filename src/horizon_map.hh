@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+
+#include "heightmap.hh"
+#include "vector3.hh"
+
+// Precomputed terrain self-shadowing for a fixed light direction (the sun)
+// For every heightmap sample, stores the elevation of the terrain horizon
+// towards the light, and the height a point must reach to see the light above
+// the terrain mesh, so that most shadow tests become a lookup
+class HorizonMap
+{
+public:
+    std::shared_ptr<Heightmap> heightmap_;
+    Vector3 light_dir_;
+    float xy_scale_;
+    float height_scale_;
+    Heightmap horizon_slopes_; // tangent of the horizon elevation (scaled)
+    Heightmap shadow_heights_; // in terrain local units (scaled heights)
+
+    HorizonMap(std::shared_ptr<Heightmap> heightmap, float xy_scale,
+               float height_scale, const Vector3 &light_dir);
+
+    bool matches(const Vector3 &light_dir) const;
+
+    // y and x are grid coordinates, height is in terrain local units
+    bool is_shadowed(double y, double x, double height) const;
+
+private:
+    float max_height_; // scaled
+    double light_slope_; // tangent of the light elevation (scaled)
+
+    // Fills both maps with one sweep along the light azimuth
+    void sweep(float no_shadow);
+
+    // Exact test of the light ray against the mesh, for points on triangles
+    // facing away from the light, and points that lie between the horizons
+    // (or shadow heights) of the surrounding samples
+    bool is_occluded(double y, double x, double height) const;
+};
@@ -5,55 +5,94 @@
 #include <iostream>
 
 #include "interval.hh"
+#include "output_sink.hh"
 #include "ppm_parser.hh"
 #include "utils.hh"
 
 Image2D::Image2D()
     : width_(0)
     , height_(0)
-    , pixels_(std::vector<std::shared_ptr<Pixel>>())
+    , format_(PixelFormat::RGBA_FLOAT)
 {}
 
-Image2D::Image2D(int width, int height)
-    : width_(width)
-    , height_(height)
-    , pixels_(std::vector<std::shared_ptr<Pixel>>(width * height))
+Image2D::Image2D(int width, int height, PixelFormat format)
+    : width_(0)
+    , height_(0)
+    , format_(format)
 {
-    for (int i = 0; i < width * height; i++)
-    {
-        pixels_[i] = std::make_shared<Pixel>(i % width, i / width, 0, 0,
-                                             0); // TODO check if it works
-    }
+    resize(width, height, format);
 }
 
 Image2D::Image2D(const Heightmap &heightmap)
-    : width_(heightmap.width_)
-    , height_(heightmap.height_)
-    , pixels_(std::vector<std::shared_ptr<Pixel>>(width_ * height_))
+    : Image2D(heightmap.width_, heightmap.height_)
 {
-    for (int i = 0; i < width_ * height_; i++)
+    for (int y = 0; y < height_; y++)
     {
-        int x = i % width_;
-        int y = i / width_;
-        double val = heightmap.at(y, x);
-        pixels_[i] = std::make_shared<Pixel>(x, y, val, val, val);
+        for (int x = 0; x < width_; x++)
+        {
+            double val = heightmap.at(y, x);
+            setPixel(y, x, val, val, val);
+        }
     }
 }
 
 Image2D::Image2D(const std::string &filename)
+    : Image2D()
 {
     PPMParser parser(filename);
     parser.parse(*this);
 }
 
+void Image2D::resize(int width, int height, PixelFormat format)
+{
+    width_ = width;
+    height_ = height;
+    format_ = format;
+
+    size_t size = 4 * static_cast<size_t>(width) * height;
+    if (format_ == PixelFormat::RGBA_FLOAT)
+    {
+        pixels_.assign(size, 0.0f);
+        pixels_8_.clear();
+        pixels_8_.shrink_to_fit();
+    }
+    else
+    {
+        pixels_8_.assign(size, 0);
+        pixels_.clear();
+        pixels_.shrink_to_fit();
+    }
+}
+
 void Image2D::setPixel(const Pixel &pixel)
 {
-    pixels_[pixel.y_ * width_ + pixel.x_] = std::make_shared<Pixel>(pixel);
+    setPixel(pixel.y_, pixel.x_, pixel.color_);
+}
+
+static uint8_t to_8_bits(double value)
+{
+    static const Interval intensity(0.0, 1.0);
+    return static_cast<uint8_t>(std::lround(255.0 * intensity.clamp(value)));
 }
 
 void Image2D::setPixel(int y, int x, double r, double g, double b, double a)
 {
-    pixels_[y * width_ + x] = std::make_shared<Pixel>(x, y, r, g, b, a);
+    size_t i = 4 * (static_cast<size_t>(y) * width_ + x);
+
+    if (format_ == PixelFormat::RGBA_FLOAT)
+    {
+        pixels_[i] = r;
+        pixels_[i + 1] = g;
+        pixels_[i + 2] = b;
+        pixels_[i + 3] = a;
+    }
+    else
+    {
+        pixels_8_[i] = to_8_bits(r);
+        pixels_8_[i + 1] = to_8_bits(g);
+        pixels_8_[i + 2] = to_8_bits(b);
+        pixels_8_[i + 3] = to_8_bits(a);
+    }
 }
 
 void Image2D::setPixel(int y, int x, Color color)
@@ -63,7 +102,16 @@ void Image2D::setPixel(int y, int x, Color color)
 
 Color Image2D::getPixel(int y, int x) const
 {
-    return pixels_[y * width_ + x]->color_;
+    size_t i = 4 * (static_cast<size_t>(y) * width_ + x);
+
+    if (format_ == PixelFormat::RGBA_FLOAT)
+    {
+        return Color(pixels_[i], pixels_[i + 1], pixels_[i + 2],
+                     pixels_[i + 3]);
+    }
+
+    return Color(pixels_8_[i] / 255.0, pixels_8_[i + 1] / 255.0,
+                 pixels_8_[i + 2] / 255.0, pixels_8_[i + 3] / 255.0);
 }
 
 Color Image2D::interpolate(float y, float x, bool loop) const
@@ -136,9 +184,10 @@ void Image2D::minMaxNormalize()
 
     for (int i = 0; i < width_ * height_; i++)
     {
-        double r = pixels_[i]->color_.r_;
-        double g = pixels_[i]->color_.g_;
-        double b = pixels_[i]->color_.b_;
+        Color color = getPixel(i / width_, i % width_);
+        double r = color.r_;
+        double g = color.g_;
+        double b = color.b_;
 
         if (r < min)
             min = r;
@@ -157,15 +206,16 @@ void Image2D::minMaxNormalize()
 
     for (int i = 0; i < width_ * height_; i++)
     {
-        double r = pixels_[i]->color_.r_;
-        double g = pixels_[i]->color_.g_;
-        double b = pixels_[i]->color_.b_;
+        Color color = getPixel(i / width_, i % width_);
+        double r = color.r_;
+        double g = color.g_;
+        double b = color.b_;
 
         r = (r - min) / (max - min);
         g = (g - min) / (max - min);
         b = (b - min) / (max - min);
 
-        pixels_[i]->color_ = Color(r, g, b);
+        setPixel(i / width_, i % width_, Color(r, g, b));
     }
 }
 
@@ -176,7 +226,7 @@ void Image2D::sobelNormalize()
 
     for (int i = 0; i < width_ * height_; i++)
     {
-        double val = pixels_[i]->color_.r_;
+        double val = getPixel(i / width_, i % width_).r_;
         if (val < min)
             min = val;
         if (val > max)
@@ -187,47 +237,38 @@ void Image2D::sobelNormalize()
 
     for (int i = 0; i < width_ * height_; i++)
     {
-        double r = ((pixels_[i]->color_.r_ / divisor) + 1.0) / 2.0;
-        double g = ((pixels_[i]->color_.r_ / divisor) + 1.0) / 2.0;
-        double b = ((pixels_[i]->color_.r_ / divisor) + 1.0) / 2.0;
+        double val = getPixel(i / width_, i % width_).r_;
+        double r = ((val / divisor) + 1.0) / 2.0;
+        double g = ((val / divisor) + 1.0) / 2.0;
+        double b = ((val / divisor) + 1.0) / 2.0;
 
-        pixels_[i]->color_ = Color(r, g, b);
+        setPixel(i / width_, i % width_, Color(r, g, b));
     }
 }
 
-void Image2D::writePPM(const char *filename,
-                       bool gamma_correct) const // P3 format raw PPM
+// Both formats are encoded by OutputSink, without its I/O thread
+static void write_image(const Image2D &image, const char *filename,
+                        OutputFormat format, bool gamma_correct)
 {
-    std::ofstream file;
-    file.open(filename);
-
-    file << "P3\n";
-    file << width_ << " " << height_ << "\n";
-    file << "255\n";
-
-    double r;
-    double g;
-    double b;
-
-    for (int i = 0; i < width_ * height_; i++)
+    try
     {
-        r = pixels_[i]->color_.r_;
-        g = pixels_[i]->color_.g_;
-        b = pixels_[i]->color_.b_;
-
-        if (gamma_correct)
-        {
-            r = Color::linear_to_gamma(r);
-            g = Color::linear_to_gamma(g);
-            b = Color::linear_to_gamma(b);
-        }
-
-        static const Interval intensity(0.0, 1.0);
-
-        file << static_cast<int>(255.999 * intensity.clamp(r)) << " "
-             << static_cast<int>(255.999 * intensity.clamp(g)) << " "
-             << static_cast<int>(255.999 * intensity.clamp(b)) << "\n";
+        OutputSink::write_image(image, filename, format, gamma_correct);
     }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+}
 
-    file.close();
-}
\ No newline at end of file
+void Image2D::writePPM(const char *filename, bool gamma_correct,
+                       bool binary) const // P3 or P6 format raw PPM
+{
+    write_image(*this, filename,
+                binary ? OutputFormat::PPM_BINARY : OutputFormat::PPM_ASCII,
+                gamma_correct);
+}
+
+void Image2D::writePFM(const char *filename) const
+{
+    write_image(*this, filename, OutputFormat::PFM, false);
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -7,17 +8,31 @@
 #include "pixel.hh"
 #include "vector3.hh"
 
+enum class PixelFormat
+{
+    RGBA_FLOAT, // 4 floats per pixel, for computed or rendered images
+    RGBA_8, // 4 bytes per pixel clamped to [0, 1], for read-only textures
+};
+
 class Image2D
 {
 public:
     int width_;
     int height_;
-    std::vector<std::shared_ptr<Pixel>> pixels_; // changer de collection ?
+    PixelFormat format_;
+
+    // Contiguous row-major buffers, only the one matching format_ is used
+    std::vector<float> pixels_;
+    std::vector<uint8_t> pixels_8_;
 
     Image2D();
-    Image2D(int width, int height);
+    Image2D(int width, int height,
+            PixelFormat format = PixelFormat::RGBA_FLOAT);
     Image2D(const Heightmap &heightmap);
-    Image2D(const std::string &filename);
+    Image2D(const std::string &filename); // PPM loaded as RGBA_8, PFM as RGBA_FLOAT
+
+    // Reallocate the buffer, pixels are reset to transparent black
+    void resize(int width, int height, PixelFormat format);
 
     void setPixel(const Pixel &pixel);
     void setPixel(int y, int x, double r, double g, double b, double a = 1.0);
@@ -31,5 +46,9 @@ public:
     void minMaxNormalize();
     void sobelNormalize();
 
-    void writePPM(const char *filename, bool gamma_correct = false) const;
-};
\ No newline at end of file
+    // ASCII (P3) or binary (P6) PPM, values clamped to [0, 1] and quantized
+    void writePPM(const char *filename, bool gamma_correct = false,
+                  bool binary = false) const;
+    // Color PFM: linear float values, neither clamped nor quantized (HDR)
+    void writePFM(const char *filename) const;
+};
@@ -1,12 +1,18 @@
 #include <cctype>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <unistd.h>
 
 #include "dla_generator.hh"
+#include "dla_walker_group.hh"
+#include "generation_cache.hh"
 #include "heightmap.hh"
+#include "heightmap_file.hh"
 #include "image2d.hh"
+#include "output_sink.hh"
 #include "rendering.hh"
 #include "scene.hh"
 
@@ -21,11 +27,20 @@ std::string capFirstLetter(std::string text)
 }
 
 void showHelpMenu(char* argv[]) {
-    std::cout << "Usage: " << argv[0] << " [-o <output_filename>] [-d <width>x<height>] [-s <scene_type>] [-p] [-h]" << std::endl;
+    std::cout << "Usage: " << argv[0] << " [-o <output_filename>] [-d <width>x<height>] [-s <scene_type>] [-t <tile_size>] [-w <width>] [-j <threads>] [-b] [-v] [-c <hmap_filename>] [-r] [-n] [-g] [-p] [-h]" << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  -o <output_filename>  Specify the path to the output file (default is images/output.ppm)" << std::endl;
+    std::cout << "  -o <output_filename>  Specify the path to the output file, PPM, PFM (.pfm, HDR) or - for raw RGB on stdout (default is images/output.ppm)" << std::endl;
     std::cout << "  -d <width>x<height>   Specify the dimensions of the output image (default is 720x480)" << std::endl;
     std::cout << "  -s <scene_type>       Specify the scene (available: test, simplex, DLA), (default is test)" << std::endl;
+    std::cout << "  -t <tile_size>        Specify the size of the square tiles rendered by each task (default is 16)" << std::endl;
+    std::cout << "  -w <width>            Compare the DLA walk modes: generate a <width> heightmap with each one (same seed), print their timings and write their previews to images/heightmaps/" << std::endl;
+    std::cout << "  -j <threads>          Number of threads simulating DLA walkers with -w (default is 0, one walker at a time)" << std::endl;
+    std::cout << "  -b                    Spawn DLA walkers on a band around the graph with -w (default is anywhere)" << std::endl;
+    std::cout << "  -v                    Move DLA walkers by SIMD groups with -w and -j (quantized directions, different result)" << std::endl;
+    std::cout << "  -c <hmap_filename>    Convert a HMAP file to HMAP v2 (floats), with its downsampled levels down to 32x32" << std::endl;
+    std::cout << "  -r                    Write the output PPM in binary (P6) instead of ASCII (P3)" << std::endl;
+    std::cout << "  -n                    Neither read nor write the generated maps in the cache (images/cache/)" << std::endl;
+    std::cout << "  -g                    Generate the DLA heightmaps of the DLA scene if they are neither in images/heightmaps/ nor cached (hours)" << std::endl;
     std::cout << "  -p                    Preview terrain heightmap only (available at images/heightmaps/)" << std::endl;
     std::cout << "  -h                    Show this help menu" << std::endl;
 }
@@ -54,6 +69,44 @@ void tmpDLADebug() {
     std::cout << "full DLA runtime : " << elapsed.count() << " seconds" << std::endl;
 }
 
+/**
+ * @brief Generate the same DLA heightmap (same seed) with each walk mode, print their runtime and number of walker moves.
+ *
+ * @param[in] width                width of the square heightmaps (power of 2 (>= 2^4))
+ * @param[in] aggregation_threads  threads simulating walkers (0 for the original single walker algorithm)
+ * @param[in] spawn_mode           where walkers start
+ * @param[in] simd_walkers         move walkers by SIMD groups (with aggregation_threads > 0)
+ */
+void compareDLAWalkModes(int width, unsigned int aggregation_threads, DLA::SpawnMode spawn_mode, bool simd_walkers) {
+    const int seed = 10;
+    const std::pair<DLA::WalkMode, std::string> walk_modes[] = {
+        { DLA::WalkMode::UNIT_STEPS, "unit_steps" },
+        { DLA::WalkMode::DISTANCE_FIELD_JUMPS, "distance_field_jumps" },
+    };
+
+    if (simd_walkers && aggregation_threads > 0) {
+        std::cout << "walker group kernel: " << DLA::WalkerGroup::kernelName() << std::endl;
+    }
+
+    for (const auto& [walk_mode, name] : walk_modes) {
+        DLA::DLAGenerator generator = DLA::DLAGenerator(0.6f, 0.5f, 0.5f, seed);
+        generator.walk_mode_ = walk_mode;
+        generator.aggregation_threads_ = aggregation_threads;
+        generator.spawn_mode_ = spawn_mode;
+        generator.simd_walkers_ = simd_walkers;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        Heightmap heightmap = generator.generateUpscaledHeightmap(width);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+
+        std::cout << name << ": " << elapsed.count() << " seconds, " << generator.walk_steps_ << " walker moves" << std::endl;
+
+        Image2D image = Image2D(heightmap);
+        image.writePPM(("../images/heightmaps/DLA_" + name + "_" + std::to_string(width) + ".ppm").c_str(), false);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     char opt;
@@ -63,11 +116,19 @@ int main(int argc, char *argv[])
     int image_width = 720;
     int image_height = 480;
     std::string scene_type = "test";
+    int tile_size = Rendering::default_tile_size;
     bool only_preview = false;
     bool show_help = false;
     bool x_debug = false;
+    int walk_comparison_width = 0;
+    int aggregation_threads = 0;
+    DLA::SpawnMode spawn_mode = DLA::SpawnMode::UNIFORM;
+    bool simd_walkers = false;
+    std::string convert_filename;
+    bool binary_ppm = false;
+    bool generate_dla_heightmaps = false;
 
-    while ((opt = getopt(argc, argv, "o:d:s:pxh")) != -1) {
+    while ((opt = getopt(argc, argv, "o:d:s:t:w:j:bvc:rngpxh")) != -1) {
         switch (opt) {
             case 'o':
                 output_filename = optarg;
@@ -78,6 +139,45 @@ int main(int argc, char *argv[])
             case 's':
                 scene_type = optarg;
                 break;
+            case 't':
+                tile_size = std::atoi(optarg);
+                if (tile_size <= 0) {
+                    std::cerr << "Error: Invalid tile size. Please use a positive integer." << std::endl;
+                    return 1;
+                }
+                break;
+            case 'w':
+                walk_comparison_width = std::atoi(optarg);
+                if (walk_comparison_width < 16 || (walk_comparison_width & (walk_comparison_width - 1)) != 0) {
+                    std::cerr << "Error: Invalid DLA width. Please use a power of 2 (>= 16)." << std::endl;
+                    return 1;
+                }
+                break;
+            case 'j':
+                aggregation_threads = std::atoi(optarg);
+                if (aggregation_threads < 0) {
+                    std::cerr << "Error: Invalid number of threads. Please use a positive integer (or 0)." << std::endl;
+                    return 1;
+                }
+                break;
+            case 'b':
+                spawn_mode = DLA::SpawnMode::AGGREGATE_BAND;
+                break;
+            case 'v':
+                simd_walkers = true;
+                break;
+            case 'c':
+                convert_filename = optarg;
+                break;
+            case 'r':
+                binary_ppm = true;
+                break;
+            case 'n':
+                GenerationCache::shared().enabled_ = false;
+                break;
+            case 'g':
+                generate_dla_heightmaps = true;
+                break;
             case 'p':
                 only_preview = true;
                 break;
@@ -88,19 +188,35 @@ int main(int argc, char *argv[])
                 show_help = true;
                 break;
             default:
-                std::cerr << "Usage: " << argv[0] << " [-o <output_filename>] [-d <width>x<height>] [-s <scene_type>] [-p] [-h]" << std::endl;
+                std::cerr << "Usage: " << argv[0] << " [-o <output_filename>] [-d <width>x<height>] [-s <scene_type>] [-t <tile_size>] [-w <width>] [-j <threads>] [-b] [-v] [-c <hmap_filename>] [-r] [-n] [-g] [-p] [-h]" << std::endl;
                 return 1;
         }
     }
 
+    if (show_help) {
+        showHelpMenu(argv);
+        return 0;
+    }
+
     if (x_debug)
     {
         tmpDLADebug();
         return 0;
     }
 
-    if (show_help) {
-        showHelpMenu(argv);
+    if (walk_comparison_width > 0)
+    {
+        compareDLAWalkModes(walk_comparison_width, aggregation_threads, spawn_mode, simd_walkers);
+        return 0;
+    }
+
+    if (!convert_filename.empty())
+    {
+        Heightmap heightmap = Heightmap::readFromFile(convert_filename);
+        HeightmapFile::write(convert_filename, heightmap, HeightmapSampleType::F32, 32);
+
+        HeightmapFile converted(convert_filename);
+        std::cout << convert_filename << ": HMAP v" << converted.version() << ", " << converted.levelCount() << " levels" << std::endl;
         return 0;
     }
 
@@ -128,6 +244,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    // (the logs of the scene setup must not end up in a frame written to the
+    // standard output either)
+    if (output_filename == "-" && !only_preview)
+    {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     Image2D image(image_width, image_height);
 
     Scene scene = Scene::createTestScene(image_height, image_width);
@@ -140,7 +263,15 @@ int main(int argc, char *argv[])
     if (scene_type == "DLA")
     {
         auto start_DLA_scene = std::chrono::high_resolution_clock::now();
-        scene = Scene::createDLAScene(image_height, image_width);
+        try
+        {
+            scene = Scene::createDLAScene(image_height, image_width, generate_dla_heightmaps);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
 
         auto end_DLA_scene = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed_DLA_scene = end_DLA_scene - start_DLA_scene;
@@ -154,14 +285,40 @@ int main(int argc, char *argv[])
     {
         auto start = std::chrono::high_resolution_clock::now();
 
-        Rendering::render(scene, image);
-        std::cout << "Rendering done" << std::endl;
+        // The rows are written while the next ones are rendered. PFM keeps
+        // the linear HDR values of the render (no gamma, no clamping)
+        try
+        {
+            OutputFormat format = OutputSink::format_of(output_filename, binary_ppm);
 
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = end - start;
-        std::cout << "Rendering runtime: " << elapsed.count() << " seconds" << std::endl;
+            // With "-", the frame goes to the standard output: the logs go to
+            // the standard error instead. The descriptors are only swapped
+            // here, a failed scene setup leaves them as they were
+            int frame_fd = -1;
+            if (output_filename == "-")
+            {
+                frame_fd = dup(STDOUT_FILENO);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+            }
+
+            std::unique_ptr<OutputSink> sink = frame_fd >= 0
+                ? std::make_unique<OutputSink>(image, frame_fd, format)
+                : std::make_unique<OutputSink>(image, output_filename, format);
 
-        image.writePPM(output_filename.c_str(), true);
+            Rendering::render(scene, image, tile_size, sink.get());
+            std::cout << "Rendering done" << std::endl;
+
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> elapsed = end - start;
+            std::cout << "Rendering runtime: " << elapsed.count() << " seconds" << std::endl;
+
+            sink->finish();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
     }
 
     return 0;
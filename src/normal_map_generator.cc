@@ -2,7 +2,9 @@
 
 #include <cmath>
 #include <iostream>
+#include <span>
 
+#include "thread_pool.hh"
 #include "utils.hh"
 
 Image2D
@@ -22,38 +24,49 @@ NormalMapGenerator::generateNormalMap(std::shared_ptr<Heightmap> height_map,
                                               { 1, 2, 1 } };
 
     // Appliquer les filtres de Sobel en utilisant la convolution
-    for (int i = 1; i < height_map->height_ - 1; ++i)
-    {
-        for (int j = 1; j < height_map->width_ - 1; ++j)
-        {
-            double gx = 0.0, gz = 0.0;
-            for (int m = -1; m <= 1; ++m)
+    ThreadPool::shared().parallel_for(
+        1, height_map->height_ - 1, 16, [&](int row_begin, int row_end) {
+            for (int i = row_begin; i < row_end; ++i)
             {
-                for (int n = -1; n <= 1; ++n)
+                const std::span<const float> rows[3] = {
+                    height_map->row(i - 1), height_map->row(i),
+                    height_map->row(i + 1)
+                };
+
+                for (int j = 1; j < height_map->width_ - 1; ++j)
                 {
-                    double height = height_map->at(i + m, j + n);
-                    gx += height * kSobelX[m + 1][n + 1];
-                    gz += height * kSobelY[m + 1][n + 1];
+                    double gx = 0.0, gz = 0.0;
+                    for (int m = -1; m <= 1; ++m)
+                    {
+                        for (int n = -1; n <= 1; ++n)
+                        {
+                            double height = rows[m + 1][j + n];
+                            gx += height * kSobelX[m + 1][n + 1];
+                            gz += height * kSobelY[m + 1][n + 1];
+                        }
+                    }
+                    gx = -1 * (gx * strength / (2 * xy_scale));
+                    gz = -1 * (gz * strength / (2 * xy_scale));
+                    sobelX.setPixel(i, j, gx, gx, gx);
+                    sobelY.setPixel(i, j, gz, gz, gz);
                 }
             }
-            gx = -1 * (gx * strength / (2 * xy_scale));
-            gz = -1 * (gz * strength / (2 * xy_scale));
-            sobelX.setPixel(i, j, gx, gx, gx);
-            sobelY.setPixel(i, j, gz, gz, gz);
-        }
-    }
+        });
 
     // Calculer la normale
-    for (int i = 0; i < height_map->height_; ++i)
-    {
-        for (int j = 0; j < height_map->width_; ++j)
-        {
-            double x = sobelX.getPixel(i, j).r_;
-            double z = sobelY.getPixel(i, j).r_;
-            Color c = Color(x, z, 1);
-            normal_map.setPixel(i, j, c);
-        }
-    }
+    ThreadPool::shared().parallel_for(
+        0, height_map->height_, 16, [&](int row_begin, int row_end) {
+            for (int i = row_begin; i < row_end; ++i)
+            {
+                for (int j = 0; j < height_map->width_; ++j)
+                {
+                    double x = sobelX.getPixel(i, j).r_;
+                    double z = sobelY.getPixel(i, j).r_;
+                    Color c = Color(x, z, 1);
+                    normal_map.setPixel(i, j, c);
+                }
+            }
+        });
 
     return normal_map;
 }
\ No newline at end of file
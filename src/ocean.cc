@@ -35,11 +35,15 @@ bool Ocean::hit(const Ray &ray, HitRecord &hit_record) const
 
     hit_record.t = t;
     hit_record.p = p;
-    hit_record.n = get_normal_at(p);
-    hit_record.tex = get_texture_at(p);
+    hit_record.obj = this;
     return true;
 }
 
+AABB Ocean::bounding_box() const
+{
+    return horizontal_plane_box(height_);
+}
+
 void Ocean::translate(const Vector3 &v)
 {
     height_ += v.y_;
@@ -15,4 +15,6 @@ public:
     void translate(const Vector3 &v) override;
 
     bool hit(const Ray &ray, HitRecord &hit_record) const override;
+
+    AABB bounding_box() const override;
 };
\ No newline at end of file
@@ -2,10 +2,23 @@
 
 #include <cmath>
 
+#include "generation_cache.hh"
 #include "ppm_parser.hh"
 #include "terrain_texture.hh"
 #include "wave_map_generator.hh"
 
+static void add_wave_parameters(CacheKey &key, const WaveMapParameters &params)
+{
+    key.add(params.foam_color_)
+        .add(params.wave_freq_)
+        .add(params.wave_max_dist_)
+        .add(params.wave_min_dist_)
+        .add(params.wave_offset_)
+        .add(params.foam_threshold_)
+        .add(params.foam_normal_min_threshold_)
+        .add(params.foam_normal_max_threshold_);
+}
+
 OceanTexture::OceanTexture(LocalTexture tex,
                            std::shared_ptr<Image2D> normal_map,
                            std::shared_ptr<Terrain> terrain, double sea_level,
@@ -16,12 +29,26 @@ OceanTexture::OceanTexture(LocalTexture tex,
     , terrain_(terrain)
 {
     auto params = WaveMapParameters();
-    wave_map_ = std::make_shared<Image2D>(
-        WaveMapGenerator::generateDeepOceanWaveMap(normal_map_, params));
-    foam_map_ =
-        std::make_shared<Image2D>(WaveMapGenerator::generateShoreWaveMap(
-            dynamic_cast<TerrainTexture *>(terrain->mat_.get())->height_map_,
-            params, sea_level));
+    auto terrain_height_map =
+        dynamic_cast<TerrainTexture *>(terrain->mat_.get())->height_map_;
+
+    // Both maps are cached, keyed by their input map and the parameters
+    GenerationCache &cache = GenerationCache::shared();
+
+    CacheKey wave_key = CacheKey("deep_ocean_wave_map/1").add(*normal_map_);
+    add_wave_parameters(wave_key, params);
+    wave_map_ = std::make_shared<Image2D>(cache.image(wave_key, [&] {
+        return WaveMapGenerator::generateDeepOceanWaveMap(normal_map_, params);
+    }));
+
+    CacheKey foam_key = CacheKey("shore_wave_map/1")
+                            .add(*terrain_height_map)
+                            .add(sea_level);
+    add_wave_parameters(foam_key, params);
+    foam_map_ = std::make_shared<Image2D>(cache.image(foam_key, [&] {
+        return WaveMapGenerator::generateShoreWaveMap(terrain_height_map,
+                                                      params, sea_level);
+    }));
 }
 
 Point3 OceanTexture::get_uv(const Point3 &p) const
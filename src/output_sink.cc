@@ -0,0 +1,311 @@
+#include "output_sink.hh"
+
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "interval.hh"
+
+// Rows are written by batches of about this size (not for streamed PFM)
+static constexpr size_t kWriteBatch = 1 << 20;
+
+OutputSink::OutputSink(const Image2D &image, const std::string &filename,
+                       OutputFormat format, bool gamma_correct)
+    : OutputSink(image,
+                 filename == "-"
+                     ? dup(STDOUT_FILENO)
+                     : open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                            0644),
+                 format, gamma_correct)
+{}
+
+OutputSink::OutputSink(const Image2D &image, int fd, OutputFormat format,
+                       bool gamma_correct)
+    : image_(image)
+    , fd_(fd)
+    , format_(format)
+    , gamma_correct_(gamma_correct)
+    , header_size_(0)
+    , row_remaining_(image.height_, image.width_)
+    , next_row_(0)
+    , stop_(false)
+    , finished_(false)
+{
+    if (fd_ < 0)
+        throw std::runtime_error("OutputSink: Unable to open the output: "
+                                 + std::string(std::strerror(errno)));
+
+    // PFM rows are stored from the bottom to the top
+    if (format_ == OutputFormat::PFM && lseek(fd_, 0, SEEK_CUR) < 0)
+    {
+        close(fd_);
+        throw std::runtime_error("OutputSink: PFM needs a seekable output");
+    }
+
+    try
+    {
+        start();
+    }
+    catch (const std::exception &e)
+    {
+        close(fd_);
+        throw std::runtime_error("OutputSink: " + std::string(e.what()));
+    }
+}
+
+OutputSink::~OutputSink()
+{
+    try
+    {
+        finish();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+}
+
+OutputFormat OutputSink::format_of(const std::string &filename,
+                                   bool binary_ppm)
+{
+    if (filename == "-")
+        return OutputFormat::RAW_RGB;
+    if (filename.ends_with(".pfm"))
+        return OutputFormat::PFM;
+    return binary_ppm ? OutputFormat::PPM_BINARY : OutputFormat::PPM_ASCII;
+}
+
+std::string OutputSink::header_of(const Image2D &image, OutputFormat format)
+{
+    std::string size =
+        std::to_string(image.width_) + " " + std::to_string(image.height_);
+
+    switch (format)
+    {
+    case OutputFormat::PPM_ASCII:
+        return "P3\n" + size + "\n255\n";
+    case OutputFormat::PPM_BINARY:
+        return "P6\n" + size + "\n255\n";
+    case OutputFormat::PFM:
+        // A negative scale means little-endian values
+        return "PF\n" + size + "\n"
+            + (std::endian::native == std::endian::little ? "-1.0" : "1.0")
+            + "\n";
+    case OutputFormat::RAW_RGB:
+        break;
+    }
+    return "";
+}
+
+void OutputSink::write_image(const Image2D &image, const std::string &filename,
+                             OutputFormat format, bool gamma_correct)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("OutputSink: Unable to open " + filename);
+
+    std::string buffer = header_of(image, format);
+    for (int i = 0; i < image.height_; i++)
+    {
+        // PFM rows are stored from the bottom to the top
+        int y = format == OutputFormat::PFM ? image.height_ - 1 - i : i;
+        encode_row(image, y, format, gamma_correct, buffer);
+
+        if (buffer.size() >= kWriteBatch)
+        {
+            file.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    file.write(buffer.data(), buffer.size());
+
+    file.close();
+    if (!file)
+        throw std::runtime_error("OutputSink: Unable to write " + filename);
+}
+
+void OutputSink::start()
+{
+    std::string header = header_of(image_, format_);
+    header_size_ = header.size();
+    write_at(header, 0);
+
+    io_thread_ = std::thread(&OutputSink::io_loop, this);
+}
+
+void OutputSink::tile_done(int y_begin, int y_end, int x_begin, int x_end)
+{
+    bool next_row_done;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int y = y_begin; y < y_end; y++)
+            row_remaining_[y] -= x_end - x_begin;
+
+        next_row_done = next_row_ < image_.height_
+            && row_remaining_[next_row_] == 0;
+    }
+
+    if (next_row_done)
+        cv_.notify_one();
+}
+
+void OutputSink::finish()
+{
+    if (finished_)
+        return;
+    finished_ = true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    io_thread_.join();
+
+    close(fd_);
+
+    if (!error_.empty())
+        throw std::runtime_error("OutputSink: " + error_);
+    if (next_row_ < image_.height_)
+        throw std::runtime_error("OutputSink: Only "
+                                 + std::to_string(next_row_) + " of "
+                                 + std::to_string(image_.height_)
+                                 + " rows were finished");
+}
+
+void OutputSink::io_loop()
+{
+    std::string buffer;
+    const size_t pfm_row_size = 3 * sizeof(float) * image_.width_;
+
+    while (true)
+    {
+        int begin;
+        int end;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] {
+                return stop_
+                    || (next_row_ < image_.height_
+                        && row_remaining_[next_row_] == 0);
+            });
+
+            // Every finished row is written before stopping
+            begin = next_row_;
+            end = begin;
+            while (end < image_.height_ && row_remaining_[end] == 0)
+                end++;
+
+            if (begin == end)
+                return;
+        }
+
+        // The rows are final: they are read without the lock
+        try
+        {
+            for (int y = begin; y < end; y++)
+            {
+                encode_row(image_, y, format_, gamma_correct_, buffer);
+
+                if (format_ == OutputFormat::PFM)
+                {
+                    write_at(buffer, header_size_
+                                 + (image_.height_ - 1 - y) * pfm_row_size);
+                    buffer.clear();
+                }
+                else if (buffer.size() >= kWriteBatch || y == end - 1)
+                {
+                    write_at(buffer, 0);
+                    buffer.clear();
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = e.what();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        next_row_ = end;
+    }
+}
+
+// Appends the decimal digits of value (in [0, 255]) to the buffer
+static void append_channel(std::string &buffer, int value)
+{
+    if (value >= 100)
+        buffer += static_cast<char>('0' + value / 100);
+    if (value >= 10)
+        buffer += static_cast<char>('0' + value / 10 % 10);
+    buffer += static_cast<char>('0' + value % 10);
+}
+
+void OutputSink::encode_row(const Image2D &image, int y, OutputFormat format,
+                            bool gamma_correct, std::string &buffer)
+{
+    static const Interval intensity(0.0, 1.0);
+
+    for (int x = 0; x < image.width_; x++)
+    {
+        size_t i = 4 * (static_cast<size_t>(y) * image.width_ + x);
+
+        if (format == OutputFormat::PFM)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                float value = image.format_ == PixelFormat::RGBA_FLOAT
+                    ? image.pixels_[i + c]
+                    : image.pixels_8_[i + c] / 255.0f;
+                buffer.append(reinterpret_cast<const char *>(&value),
+                              sizeof(float));
+            }
+            continue;
+        }
+
+        Color color = image.getPixel(y, x);
+        double rgb[3] = { color.r_, color.g_, color.b_ };
+
+        for (int c = 0; c < 3; c++)
+        {
+            double value = rgb[c];
+            if (gamma_correct)
+                value = Color::linear_to_gamma(value);
+
+            int channel = static_cast<int>(255.999 * intensity.clamp(value));
+            if (format == OutputFormat::PPM_ASCII)
+            {
+                append_channel(buffer, channel);
+                buffer += c < 2 ? ' ' : '\n';
+            }
+            else
+                buffer += static_cast<char>(channel);
+        }
+    }
+}
+
+// offset is only used for PFM, the other formats are written sequentially
+void OutputSink::write_at(const std::string &buffer, size_t offset)
+{
+    size_t written = 0;
+    while (written < buffer.size())
+    {
+        ssize_t count = format_ == OutputFormat::PFM
+            ? pwrite(fd_, buffer.data() + written, buffer.size() - written,
+                     offset + written)
+            : write(fd_, buffer.data() + written, buffer.size() - written);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            throw std::runtime_error("Unable to write the output: "
+                                     + std::string(std::strerror(errno)));
+        written += count;
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image2d.hh"
+
+enum class OutputFormat
+{
+    PPM_ASCII, // P3
+    PPM_BINARY, // P6
+    PFM, // color PFM, linear floats (not clamped, gamma_correct is ignored)
+    RAW_RGB, // 8 bit RGB without any header (e.g. piped into a video encoder)
+};
+
+// Writes an image to a file while it is being rendered.
+// Render workers report the pixels they have finished with tile_done(), a
+// background I/O thread encodes every row as soon as it and all the rows above
+// it are finished, and writes it (in order, except PFM rows which are written
+// at their place, from the bottom of the file). Rows are encoded one at a
+// time, the image is never copied.
+class OutputSink
+{
+public:
+    // "-" writes to the standard output (not seekable: not for PFM)
+    OutputSink(const Image2D &image, const std::string &filename,
+               OutputFormat format, bool gamma_correct = true);
+
+    // Writes to (and closes) an already open file descriptor
+    OutputSink(const Image2D &image, int fd, OutputFormat format,
+               bool gamma_correct = true);
+
+    // Finishes (errors are only printed)
+    ~OutputSink();
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    // Pixels [y_begin, y_end) x [x_begin, x_end) of the image are final
+    // (thread safe, each pixel must be reported once)
+    void tile_done(int y_begin, int y_end, int x_begin, int x_end);
+
+    // Waits until the reported rows are written, and closes the output.
+    // Throws std::runtime_error if the output could not be written
+    void finish();
+
+    // Format matching the extension of filename ("-" is RAW_RGB)
+    static OutputFormat format_of(const std::string &filename,
+                                  bool binary_ppm = false);
+
+    // Writes a finished image at once, on the calling thread (no I/O thread).
+    // Throws std::runtime_error if the file could not be written
+    static void write_image(const Image2D &image, const std::string &filename,
+                            OutputFormat format, bool gamma_correct = true);
+
+private:
+    const Image2D &image_;
+    int fd_;
+    OutputFormat format_;
+    bool gamma_correct_;
+
+    size_t header_size_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<int> row_remaining_; // pixels of each row not finished yet
+    int next_row_; // first row not written yet
+    bool stop_;
+    std::string error_;
+
+    std::thread io_thread_;
+    bool finished_;
+
+    void start();
+    void io_loop();
+
+    static std::string header_of(const Image2D &image, OutputFormat format);
+
+    // Appends the encoded row y of image to buffer
+    static void encode_row(const Image2D &image, int y, OutputFormat format,
+                           bool gamma_correct, std::string &buffer);
+
+    void write_at(const std::string &buffer, size_t offset);
+};
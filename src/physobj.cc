@@ -1,5 +1,7 @@
 #include "physobj.hh"
 
+#include "utils.hh"
+
 PhysObj::PhysObj()
     : mat_(std::make_shared<UniformTexture>(default_mat))
     , translation_(Vector3(0, 0, 0))
@@ -10,6 +12,18 @@ PhysObj::PhysObj(std::shared_ptr<TextureMaterial> mat)
     , translation_(Vector3(0, 0, 0))
 {}
 
+void PhysObj::fill_shading(HitRecord &hit_record) const
+{
+    hit_record.n = get_normal_at(hit_record.p);
+    hit_record.tex = get_texture_at(hit_record.p);
+}
+
+bool PhysObj::precomputed_shadow(const Point3 &, const Vector3 &,
+                                 bool &) const
+{
+    return false;
+}
+
 LocalTexture PhysObj::get_texture_at(const Point3 &p) const
 {
     return mat_->get_texture_at(p);
@@ -18,4 +32,11 @@ LocalTexture PhysObj::get_texture_at(const Point3 &p) const
 Vector3 PhysObj::get_normal_at(const Point3 &p) const
 {
     return Vector3::unit_vector(mat_->get_normal_at(p));
+}
+
+AABB PhysObj::horizontal_plane_box(double height)
+{
+    return AABB(Point3(-utils::infinity, height, -utils::infinity),
+                Point3(utils::infinity, height, utils::infinity))
+        .pad(utils::kEpsilon);
 }
\ No newline at end of file
@@ -2,14 +2,22 @@
 
 #include <memory>
 
+#include "aabb.hh"
 #include "material.hh"
 #include "ray.hh"
 #include "vector3.hh"
 
+class PhysObj;
+
+// Filled in two passes: hit() only sets the geometry (t, p, obj, barycentric
+// coordinates), fill_shading() sets the normal and texture of the final hit
 struct HitRecord
 {
     double t;
     Point3 p;
+    const PhysObj *obj = nullptr; // object that was hit
+    double u = 0.0; // barycentric coordinates, for triangles
+    double v = 0.0;
     Vector3 n;
     LocalTexture tex;
 };
@@ -26,10 +34,25 @@ public:
 
     virtual ~PhysObj() = default;
 
+    // Geometry only, does not evaluate the material
     virtual bool hit(const Ray &ray, HitRecord &hit_record) const = 0;
 
+    // Normal and texture at a hit found by hit()
+    virtual void fill_shading(HitRecord &hit_record) const;
+
+    // Shadow cast by this object alone on p, when it can be answered without
+    // tracing a ray (returns false otherwise)
+    virtual bool precomputed_shadow(const Point3 &p, const Vector3 &light_dir,
+                                    bool &shadowed) const;
+
+    // World space bounds, infinite along the axes an object is unbounded on
+    virtual AABB bounding_box() const = 0;
+
     virtual void translate(const Vector3 &v) = 0;
 
     virtual LocalTexture get_texture_at(const Point3 &p) const;
     virtual Vector3 get_normal_at(const Point3 &p) const;
+
+    // Bounds of an infinite horizontal plane at the given height
+    static AABB horizontal_plane_box(double height);
 };
\ No newline at end of file
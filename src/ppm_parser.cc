@@ -1,54 +1,232 @@
 #include "ppm_parser.hh"
 
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
 PPMParser::PPMParser(const std::string &filename)
     : filename_(filename)
+    , pos_(0)
 {}
 
 bool PPMParser::parse(Image2D &img)
 {
-    std::ifstream file(filename_, std::ios::binary);
+    std::ifstream file(filename_, std::ios::binary | std::ios::ate);
     if (!file.is_open())
     {
         std::cerr << "Error: Failed to open file " << filename_ << std::endl;
         return false;
     }
 
+    // Read the whole file in a single call
+    std::streamoff size = file.tellg();
+    if (size < 0)
+    {
+        std::cerr << "Error: Failed to read file " << filename_ << std::endl;
+        return false;
+    }
+    data_.resize(size);
+    file.seekg(0);
+    file.read(data_.data(), data_.size());
+    if (file.gcount() != size)
+    {
+        // (the binary payloads would be parsed from a partly filled buffer)
+        std::cerr << "Error: Truncated read of file " << filename_ << std::endl;
+        return false;
+    }
+    pos_ = 0;
+
     std::string magic;
-    file >> magic;
-    if (magic != "P3")
+    readHeaderToken(magic);
+
+    if (magic == "P3" || magic == "P6")
+        return parsePPM(img, magic == "P6");
+    if (magic == "PF" || magic == "Pf")
+        return parsePFM(img, magic == "PF" ? 3 : 1);
+
+    std::cerr << "Error: Invalid PPM magic number. Expected P3, P6, PF or Pf."
+              << std::endl;
+    return false;
+}
+
+// Next whitespace separated token of the header (comments are skipped)
+bool PPMParser::readHeaderToken(std::string &token)
+{
+    token.clear();
+
+    while (pos_ < data_.size())
+    {
+        if (data_[pos_] == '#')
+        {
+            while (pos_ < data_.size() && data_[pos_] != '\n')
+                pos_++;
+        }
+        else if (std::isspace(static_cast<unsigned char>(data_[pos_])))
+            pos_++;
+        else
+            break;
+    }
+
+    while (pos_ < data_.size()
+           && !std::isspace(static_cast<unsigned char>(data_[pos_])))
+        token += data_[pos_++];
+
+    return !token.empty();
+}
+
+bool PPMParser::readHeaderInt(int &value)
+{
+    std::string token;
+    if (!readHeaderToken(token))
+        return false;
+
+    char *end;
+    value = std::strtol(token.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+bool PPMParser::parsePPM(Image2D &img, bool binary)
+{
+    int width, height, max_val;
+    if (!readHeaderInt(width) || !readHeaderInt(height)
+        || !readHeaderInt(max_val) || width < 0 || height < 0)
     {
-        std::cerr << "Error: Invalid PPM magic number. Expected P3."
+        std::cerr << "Error: Invalid PPM header in " << filename_ << std::endl;
+        return false;
+    }
+    if (max_val <= 0 || max_val > 65535)
+    {
+        std::cerr << "Error: Unsupported max pixel value. Expected 1 to 65535."
                   << std::endl;
         return false;
     }
 
-    file >> img.width_ >> img.height_;
-    int max_val;
-    file >> max_val;
-    if (max_val != 255)
+    // Consume the whitespace character after the max value
+    pos_++;
+
+    const size_t values = 3 * static_cast<size_t>(width) * height;
+    const int sample_bytes = max_val > 255 ? 2 : 1;
+    if (binary && pos_ + values * sample_bytes > data_.size())
     {
-        std::cerr << "Error: Unsupported max pixel value. Expected 255."
-                  << std::endl;
+        std::cerr << "Error: Truncated PPM file " << filename_ << std::endl;
         return false;
     }
 
-    // Consume the newline character after the max value
-    file.ignore(1);
+    img.resize(width, height, PixelFormat::RGBA_8);
 
-    img.pixels_.resize(img.width_ * img.height_);
+    // Values are rescaled to [0, 255] (no-op for the usual max value of 255)
+    auto to_8_bits = [max_val](int value) {
+        if (max_val == 255)
+            return static_cast<uint8_t>(std::min(value, 255));
+        return static_cast<uint8_t>(
+            std::lround(255.0 * std::min(value, max_val) / max_val));
+    };
 
-    for (int y = 0; y < img.height_; ++y)
+    const unsigned char *data =
+        reinterpret_cast<const unsigned char *>(data_.data());
+    const size_t size = data_.size();
+    uint8_t *out = img.pixels_8_.data();
+
+    for (size_t i = 0; i < values; i++)
     {
-        for (int x = 0; x < img.width_; ++x)
+        int value = 0;
+
+        if (binary)
+        {
+            value = data[pos_++];
+            if (sample_bytes == 2) // (big-endian)
+                value = (value << 8) | data[pos_++];
+        }
+        else
+        {
+            while (pos_ < size && (data[pos_] < '0' || data[pos_] > '9'))
+            {
+                if (data[pos_] == '#')
+                {
+                    while (pos_ < size && data[pos_] != '\n')
+                        pos_++;
+                }
+                else
+                    pos_++;
+            }
+            if (pos_ == size)
+            {
+                std::cerr << "Error: Truncated PPM file " << filename_
+                          << std::endl;
+                return false;
+            }
+
+            while (pos_ < size && data[pos_] >= '0' && data[pos_] <= '9')
+                value = std::min(10 * value + (data[pos_++] - '0'), 65535);
+        }
+
+        // RGB to RGBA (alpha is left at 255)
+        size_t pixel = i / 3;
+        out[4 * pixel + i % 3] = to_8_bits(value);
+        if (i % 3 == 2)
+            out[4 * pixel + 3] = 255;
+    }
+
+    return true;
+}
+
+bool PPMParser::parsePFM(Image2D &img, int channels)
+{
+    int width, height;
+    std::string scale_token;
+    if (!readHeaderInt(width) || !readHeaderInt(height)
+        || !readHeaderToken(scale_token) || width < 0 || height < 0)
+    {
+        std::cerr << "Error: Invalid PFM header in " << filename_ << std::endl;
+        return false;
+    }
+
+    // A negative scale means little-endian values
+    double scale = std::atof(scale_token.c_str());
+    bool swap = (scale < 0) != (std::endian::native == std::endian::little);
+
+    // Consume the whitespace character after the scale
+    pos_++;
+
+    const size_t row_values = static_cast<size_t>(channels) * width;
+    if (pos_ + row_values * height * sizeof(float) > data_.size())
+    {
+        std::cerr << "Error: Truncated PFM file " << filename_ << std::endl;
+        return false;
+    }
+
+    img.resize(width, height, PixelFormat::RGBA_FLOAT);
+
+    std::vector<float> row(row_values);
+    for (int y = 0; y < height; y++)
+    {
+        // Rows are stored from the bottom to the top
+        const char *source =
+            data_.data() + pos_ + (height - 1 - y) * row_values * sizeof(float);
+        std::memcpy(row.data(), source, row_values * sizeof(float));
+
+        if (swap)
+        {
+            for (float &value : row)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                bits = __builtin_bswap32(bits);
+                std::memcpy(&value, &bits, sizeof(bits));
+            }
+        }
+
+        float *out = img.pixels_.data() + 4 * static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; x++)
         {
-            int r, g, b;
-            file >> r >> g >> b;
-            img.setPixel(y, x,
-                         Color(static_cast<double>(r) / 255.0,
-                               static_cast<double>(g) / 255.0,
-                               static_cast<double>(b) / 255.0));
+            for (int c = 0; c < 3; c++)
+                out[4 * x + c] = row[channels * x + (channels == 3 ? c : 0)];
+            out[4 * x + 3] = 1.0f;
         }
     }
 
     return true;
-}
\ No newline at end of file
+}
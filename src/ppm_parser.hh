@@ -7,6 +7,9 @@
 #include "color.hh"
 #include "image2d.hh"
 
+// Reads ASCII (P3) and binary (P6) PPM files into RGBA_8 images, and color
+// (PF) or grayscale (Pf) PFM files into RGBA_FLOAT images.
+// The whole file is read at once and parsed in memory.
 class PPMParser
 {
 public:
@@ -15,4 +18,14 @@ public:
     PPMParser(const std::string &filename);
 
     bool parse(Image2D &pixels);
-};
\ No newline at end of file
+
+private:
+    std::vector<char> data_;
+    size_t pos_;
+
+    bool readHeaderToken(std::string &token);
+    bool readHeaderInt(int &value);
+
+    bool parsePPM(Image2D &img, bool binary);
+    bool parsePFM(Image2D &img, int channels);
+};
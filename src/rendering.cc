@@ -1,31 +1,53 @@
 #include "rendering.hh"
 
+#include <algorithm>
+#include <atomic>
+
 #include "thread_pool.hh"
 #include "utils.hh"
 
-void Rendering::render(Scene &scene, Image2D &image)
+void Rendering::render(Scene &scene, Image2D &image, int tile_size,
+                       OutputSink *sink)
 {
-    unsigned int numThreads = std::thread::hardware_concurrency();
-    std::cout << "Number of threads: " << numThreads << std::endl;
-    ThreadPool pool(numThreads);
+    ThreadPool &pool = ThreadPool::shared();
+    std::cout << "Number of threads: " << pool.size() << std::endl;
+    TaskGroup tiles(pool);
+
+    int tiles_y = (image.height_ + tile_size - 1) / tile_size;
+    int tiles_x = (image.width_ + tile_size - 1) / tile_size;
+
+    // Each task renders the next tile nobody has claimed yet, in row-major
+    // order whatever task the pool runs first: with a sink, the top rows are
+    // done first and can be written early
+    std::atomic<int> next_tile(0);
 
-    for (int y = 0; y < image.height_; y++)
+    for (int task = 0; task < tiles_y * tiles_x; task++)
     {
-        // One thread per row
-        pool.enqueue([y, &scene, &image] {
-            for (int x = 0; x < image.width_; x++)
+        tiles.run([&next_tile, tiles_x, tile_size, &scene, &image, sink] {
+            int index = next_tile++;
+            int tile_y = index / tiles_x * tile_size;
+            int tile_x = index % tiles_x * tile_size;
+
+            int end_y = std::min(tile_y + tile_size, image.height_);
+            int end_x = std::min(tile_x + tile_size, image.width_);
+
+            for (int y = tile_y; y < end_y; y++)
             {
-                Ray ray = scene.cam_.getRayAt(y, x);
-                auto pixel_color = castRay(ray, scene, 1, scene.fog_);
-                image.setPixel(y, x, pixel_color);
+                for (int x = tile_x; x < end_x; x++)
+                {
+                    Ray ray = scene.cam_.getRayAt(y, x);
+                    auto pixel_color = castRay(ray, scene, 1, scene.fog_);
+                    image.setPixel(y, x, pixel_color);
+                }
             }
+
+            if (sink)
+                sink->tile_done(tile_y, end_y, tile_x, end_x);
         });
     }
 
-    while (!pool.isQueueEmpty())
-    {
-        this_thread::sleep_for(chrono::milliseconds(100));
-    }
+    // Returns as soon as the last tile is done
+    tiles.wait();
 }
 
 Color Rendering::castRay(const Ray &ray, const Scene &scene, int iter,
@@ -35,10 +57,13 @@ Color Rendering::castRay(const Ray &ray, const Scene &scene, int iter,
         return Color(0.0, 0.0, 0.0);
 
     HitRecord closest_hit_record;
-    bool has_hit = getClosestObj(ray, scene.objects_, closest_hit_record);
+    bool has_hit = getClosestObj(ray, *scene.bvh_, closest_hit_record);
 
     if (has_hit)
     {
+        // Only the winning hit pays for the normal and texture lookups
+        closest_hit_record.obj->fill_shading(closest_hit_record);
+
         Point3 p = closest_hit_record.p;
         Vector3 n = closest_hit_record.n;
         LocalTexture loc_tex = closest_hit_record.tex;
@@ -54,7 +79,7 @@ Color Rendering::castRay(const Ray &ray, const Scene &scene, int iter,
             Vector3 light_dir = light->computeDir(p);
             Ray light_dir_ray =
                 Ray(p + (utils::kEpsilon * light_dir), light_dir);
-            bool has_hit_light_dir = hasAnyObj(light_dir_ray, scene.objects_);
+            bool has_hit_light_dir = isInShadow(light_dir_ray, scene);
 
             double light_intensity = light->computeIntensity(light_dir_ray);
             if (has_hit_light_dir)
@@ -125,42 +150,36 @@ Color Rendering::castRay(const Ray &ray, const Scene &scene, int iter,
     return scene.skybox_->getSkyboxAt(ray.direction_);
 }
 
-bool Rendering::getClosestObj(const Ray &ray,
-                              const list<shared_ptr<PhysObj>> &objects,
+bool Rendering::getClosestObj(const Ray &ray, const BVH &bvh,
                               HitRecord &hit_record)
 {
-    HitRecord closest_hit_record;
-    closest_hit_record.t = utils::infinity;
-    bool hit_anything = false;
-    for (auto const &object : objects)
-    {
-        HitRecord object_hit_record;
-        bool has_hit = object->hit(ray, object_hit_record);
-        if (has_hit && object_hit_record.t < closest_hit_record.t)
-        {
-            closest_hit_record = object_hit_record;
-            hit_anything = true;
-        }
-    }
-    if (!hit_anything)
-    {
-        return false;
-    }
+    return bvh.hit(ray, hit_record);
+}
 
-    hit_record = closest_hit_record;
-    return hit_anything;
+bool Rendering::hasAnyObj(const Ray &ray, const BVH &bvh,
+                          const PhysObj *skipped)
+{
+    return bvh.hit_any(ray, skipped);
 }
 
-bool Rendering::hasAnyObj(const Ray &ray,
-                          const list<shared_ptr<PhysObj>> &objects)
+// Objects with a precomputed shadow (terrain horizon maps) are answered with
+// a lookup, only the remaining occluders need a ray
+bool Rendering::isInShadow(const Ray &light_ray, const Scene &scene)
 {
-    for (auto const &object : objects)
+    const PhysObj *mapped = nullptr;
+
+    for (auto const &object : scene.shadow_mapped_objects_)
     {
-        HitRecord object_hit_record;
-        if (object->hit(ray, object_hit_record))
+        bool shadowed = false;
+        if (object->precomputed_shadow(light_ray.origin_, light_ray.direction_,
+                                       shadowed))
         {
-            return true;
+            if (shadowed)
+                return true;
+            mapped = object.get();
+            break;
         }
     }
-    return false;
+
+    return hasAnyObj(light_ray, *scene.bvh_, mapped);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "image2d.hh"
+#include "output_sink.hh"
 #include "scene.hh"
 
 using std::shared_ptr;
@@ -10,17 +11,25 @@ class Rendering
 {
 public:
     static constexpr int max_iter = 2;
+    static constexpr int default_tile_size = 16;
 
-    static void render(Scene &scene, Image2D &image);
+    // Square tiles are scheduled on the shared work-stealing pool, so that
+    // cheap tiles (sky, ocean) do not leave cores idle at the end of the frame
+    // Finished tiles are reported to sink (if any), which writes the rows
+    // while the next ones are rendered
+    static void render(Scene &scene, Image2D &image,
+                       int tile_size = default_tile_size,
+                       OutputSink *sink = nullptr);
 
     static Color
     castRay(const Ray &ray, const Scene &scene, int iter,
             shared_ptr<AbsorptionVolume> absorption_volume = nullptr);
 
-    static bool getClosestObj(const Ray &ray,
-                              const list<shared_ptr<PhysObj>> &objects,
+    static bool getClosestObj(const Ray &ray, const BVH &bvh,
                               HitRecord &hit_record);
 
-    static bool hasAnyObj(const Ray &ray,
-                          const list<shared_ptr<PhysObj>> &objects);
+    static bool hasAnyObj(const Ray &ray, const BVH &bvh,
+                          const PhysObj *skipped = nullptr);
+
+    static bool isInShadow(const Ray &light_ray, const Scene &scene);
 };
\ No newline at end of file
@@ -1,9 +1,14 @@
 #include "scene.hh"
 
+#include <filesystem>
+#include <iostream>
 #include <memory>
+#include <stdexcept>
 
 #include "dla_generator.hh"
+#include "generation_cache.hh"
 #include "heightmap.hh"
+#include "heightmap_file.hh"
 #include "ocean.hh"
 #include "ocean_texture.hh"
 #include "simplex_island_generator.hh"
@@ -21,7 +26,38 @@ Scene::Scene(Camera cam, list<shared_ptr<PhysObj>> objects,
     , skybox_(skybox)
     , ambient_light_(ambient_light)
     , fog_(fog)
-{}
+{
+    // The oceanic plan of a terrain is infinite, as an object of its own it is
+    // kept out of the BVH instead of the terrain
+    for (auto const &object : objects)
+    {
+        auto terrain = std::dynamic_pointer_cast<Terrain>(object);
+        if (terrain && terrain->oceanic_plan_)
+            objects_.push_back(terrain->oceanic_plan_);
+    }
+    bvh_ = make_shared<BVH>(objects_);
+
+    // The sun direction is fixed, precompute terrain self-shadowing for it
+    for (auto const &light : lights_)
+    {
+        auto sunlight = std::dynamic_pointer_cast<SunLight>(light);
+        if (!sunlight)
+            continue;
+
+        for (auto const &object : objects_)
+        {
+            auto terrain = std::dynamic_pointer_cast<Terrain>(object);
+            if (!terrain)
+                continue;
+
+            terrain->compute_horizon_map(sunlight->computeDir(Point3()));
+            shadow_mapped_objects_.push_back(terrain);
+        }
+
+        // A terrain holds a single horizon map
+        break;
+    }
+}
 
 Scene Scene::createTestScene(int image_height, int image_width)
 {
@@ -104,9 +140,31 @@ Scene Scene::createSimplexScene(int image_height, int image_width)
     SimplexIslandParameters params =
         SimplexIslandParameters(scale, offset_x, offset_y, offset_z, 1.0f);
 
-    SimplexIslandGenerator simplexIslandGenerator = SimplexIslandGenerator();
-    simplexIslandGenerator.generateHeightmaps(base_heightmap,
-                                              upscaled_heightmap, params);
+    // Both heightmaps are cached, keyed by the generator parameters
+    GenerationCache &cache = GenerationCache::shared();
+    CacheKey base_key = CacheKey("simplex_island/1")
+                            .add(params.scale)
+                            .add(params.amplitude)
+                            .add(params.lacunarity)
+                            .add(params.persistence)
+                            .add(params.offset_x)
+                            .add(params.offset_y)
+                            .add(params.offset_z)
+                            .add(params.flatness_amount)
+                            .add(base_heightmap.width_)
+                            .add(upscaled_heightmap.width_);
+    CacheKey upscaled_key = CacheKey("simplex_island_upscaled/1").add(base_key);
+
+    if (!cache.load(base_key, base_heightmap)
+        || !cache.load(upscaled_key, upscaled_heightmap))
+    {
+        SimplexIslandGenerator simplexIslandGenerator = SimplexIslandGenerator();
+        simplexIslandGenerator.generateHeightmaps(base_heightmap,
+                                                  upscaled_heightmap, params);
+
+        cache.store(base_key, base_heightmap);
+        cache.store(upscaled_key, upscaled_heightmap);
+    }
 
     // To preview the heightmaps
     Image2D base_img = Image2D(base_heightmap);
@@ -168,7 +226,7 @@ Scene Scene::createSimplexScene(int image_height, int image_width)
     return Scene(cam, objs, lights, skybox, ambient_light, fog);
 }
 
-Scene Scene::createDLAScene(int image_height, int image_width)
+Scene Scene::createDLAScene(int image_height, int image_width, bool generate_heightmaps)
 {
     double sea_level = 0.1;
     double xy_scale = 0.325; // 1.3 for 32x32 mesh, 0.65 for 64x64 mesh, 0.325 for 128x128 mesh
@@ -187,9 +245,80 @@ Scene Scene::createDLAScene(int image_height, int image_width)
 
     // =====
 
-    Heightmap upscaled_heightmap = Heightmap::readFromFile("../images/heightmaps/DLA_upscaled_flattened_2048_2.hmap");
-
-    Heightmap base_heightmap = Heightmap::readFromFile("../images/heightmaps/DLA_base_flattened_128_2.hmap");
+    const std::string upscaled_filename = "../images/heightmaps/DLA_upscaled_flattened_2048_2.hmap";
+    Heightmap upscaled_heightmap(0, 0);
+    Heightmap base_heightmap(0, 0);
+
+    if (std::filesystem::exists(upscaled_filename))
+    {
+        // The maps are memory mapped. A HMAP v2 file written with its downsampled levels (main -c) already holds the
+        // 128 base heightmap, otherwise it is read from its own file.
+        HeightmapFile upscaled_file(upscaled_filename);
+        upscaled_heightmap = upscaled_file.readLevel(0);
+
+        int base_level = upscaled_file.findLevel(128);
+        base_heightmap = base_level != -1 && upscaled_file.level(base_level).width == 128
+            ? upscaled_file.readLevel(base_level)
+            : Heightmap::readFromFile("../images/heightmaps/DLA_base_flattened_128_2.hmap");
+    }
+    else
+    {
+        // Without the hand-copied heightmaps, they are read from the generation cache. Only if the caller allows it,
+        // they are generated once (hours) and stored there. The generator saves checkpoints next to the cache entry,
+        // an interrupted generation goes on from its last one.
+        const int seed = 10;
+        const float flatten_threshold = 0.05f; // (the hand-copied heightmaps are flattened too)
+        DLA::DLAGenerator generator = DLA::DLAGenerator(0.6, 0.5, 0.5, seed);
+        GenerationCache &cache = GenerationCache::shared();
+        CacheKey upscaled_key = CacheKey("dla/2")
+                                    .add(generator.density_threshold_)
+                                    .add(generator.graph_center_y_)
+                                    .add(generator.graph_center_x_)
+                                    .add(seed)
+                                    .add(static_cast<int>(generator.walk_mode_))
+                                    .add(static_cast<int>(generator.spawn_mode_))
+                                    .add(generator.aggregation_threads_ > 0 ? 1 : 0)
+                                    .add(generator.simd_walkers_ ? 1 : 0)
+                                    .add(2048)
+                                    .add(static_cast<double>(flatten_threshold));
+        CacheKey base_key = CacheKey("dla_base/2").add(upscaled_key).add(128);
+
+        if (!cache.load(upscaled_key, upscaled_heightmap) || !cache.load(base_key, base_heightmap))
+        {
+            if (!generate_heightmaps)
+            {
+                throw std::runtime_error("createDLAScene: Missing " + upscaled_filename + " and its cache entry "
+                                         + cache.path(upscaled_key, ".hmap") + " (generate it with -g, in hours)");
+            }
+
+            std::string checkpoint_filename = cache.path(upscaled_key, ".ckpt");
+            std::cout << "Generating the 2048x2048 DLA heightmap, this takes hours";
+            if (cache.enabled_)
+            {
+                std::cout << " (stored in " << cache.path(upscaled_key, ".hmap") << ", checkpoints in "
+                          << checkpoint_filename << ")";
+            }
+            std::cout << std::endl;
+            bool resume = cache.enabled_ && std::filesystem::exists(checkpoint_filename);
+            if (cache.enabled_)
+            {
+                std::filesystem::create_directories(std::filesystem::path(checkpoint_filename).parent_path());
+                generator.checkpoint_filename_ = checkpoint_filename;
+            }
+
+            upscaled_heightmap = resume ? generator.resumeUpscaledHeightmap(checkpoint_filename)
+                                        : generator.generateUpscaledHeightmap(2048);
+            upscaled_heightmap = upscaled_heightmap.flattenSides(flatten_threshold);
+            base_heightmap = upscaled_heightmap.squareDownsample(128);
+
+            cache.store(upscaled_key, upscaled_heightmap);
+            cache.store(base_key, base_heightmap);
+            if (cache.enabled_)
+            {
+                std::filesystem::remove(checkpoint_filename);
+            }
+        }
+    }
 
     // =====
 
@@ -218,6 +347,8 @@ Scene Scene::createDLAScene(int image_height, int image_width)
 
     list<shared_ptr<PhysObj>> objs;
 
+    // The mesh (and its horizon map) uses the base heightmap, the upscaled
+    // one only details the textures and normals
     auto terrain =
         Terrain::create_terrain(heightmap, xy_scale, strength, terrain_tex,
                                 Vector3(-20, -(sea_level * strength), -43));
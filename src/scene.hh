@@ -4,6 +4,7 @@
 #include <memory>
 
 #include "absorption_volume.hh"
+#include "bvh.hh"
 #include "camera.hh"
 #include "image2d.hh"
 #include "light.hh"
@@ -23,6 +24,8 @@ public:
     shared_ptr<SkyBox> skybox_;
     shared_ptr<AmbientLight> ambient_light_;
     shared_ptr<AbsorptionVolume> fog_;
+    shared_ptr<BVH> bvh_; // built over objects_ once the scene is constructed
+    list<shared_ptr<PhysObj>> shadow_mapped_objects_; // have horizon maps
 
     Scene(Camera cam, list<shared_ptr<PhysObj>> objects,
           list<shared_ptr<Light>> lights, shared_ptr<SkyBox> skybox = nullptr,
@@ -31,5 +34,8 @@ public:
 
     static Scene createTestScene(int image_height, int image_width);
     static Scene createSimplexScene(int image_height, int image_width);
-    static Scene createDLAScene(int image_height, int image_width);
+    // Without the hand-copied DLA heightmaps, generate_heightmaps allows
+    // generating them (hours, then cached), otherwise std::runtime_error
+    static Scene createDLAScene(int image_height, int image_width,
+                                bool generate_heightmaps = false);
 };
\ No newline at end of file
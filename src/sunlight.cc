@@ -20,6 +20,7 @@ double SunLight::computeIntensity(const Ray &ray) const
         HitRecord hit_record;
         if (clouds_plan_->hit(ray, hit_record))
         {
+            clouds_plan_->fill_shading(hit_record);
             double clouds_shadow = 1.0
                 - (clouds_plan_->clouds_max_opacity_
                    * hit_record.tex.color_.r_);
@@ -1,10 +1,12 @@
 #include "terrain.hh"
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 
 #include "terrain_texture.hh"
 
-Point3 Terrain::make_terrain_point_at(int y, int x, float height)
+Point3 Terrain::make_terrain_point_at(int y, int x, float height) const
 {
     return Point3(xy_scale_ * x, height_scale_ * height, xy_scale_ * y);
 }
@@ -16,9 +18,8 @@ Terrain::Terrain(int height, int width, shared_ptr<TextureMaterial> mat)
     , xy_scale_(1)
     , height_scale_(1)
     , heightmap_(std::make_shared<Heightmap>(width, height))
-    , mesh_(height,
-            vector<SquareTriangle>(width, SquareTriangle(nullptr, nullptr)))
     , oceanic_plan_(nullptr)
+    , horizon_map_(nullptr)
 {}
 
 Terrain::Terrain(shared_ptr<Heightmap> heightmap, float xy_scale,
@@ -29,45 +30,16 @@ Terrain::Terrain(shared_ptr<Heightmap> heightmap, float xy_scale,
     , xy_scale_(xy_scale)
     , height_scale_(height_scale)
     , heightmap_(heightmap)
-    , mesh_(heightmap->height_,
-            vector<SquareTriangle>(heightmap->width_,
-                                   SquareTriangle(nullptr, nullptr)))
     , oceanic_plan_(std::make_shared<TerrainOceanicPlan>(
           0,
           std::dynamic_pointer_cast<TerrainTexture>(mat)
               ->params_.beach_texture_))
+    , horizon_map_(nullptr)
 {}
 
 void Terrain::create_mesh()
 {
-    for (int y = 0; y < heightmap_->height_ - 1; y++)
-    {
-        for (int x = 0; x < heightmap_->width_ - 1; x++)
-        {
-            float top_left_corner_h = heightmap_->at(y, x);
-            float top_right_corner_h = heightmap_->at(y, x + 1);
-            float bot_left_corner_h = heightmap_->at(y + 1, x);
-            float bot_right_corner_h = heightmap_->at(y + 1, x + 1);
-
-            Point3 top_left_corner =
-                make_terrain_point_at(y, x, top_left_corner_h);
-            Point3 top_right_corner =
-                make_terrain_point_at(y, x + 1, top_right_corner_h);
-            Point3 bot_left_corner =
-                make_terrain_point_at(y + 1, x, bot_left_corner_h);
-            Point3 bot_right_corner =
-                make_terrain_point_at(y + 1, x + 1, bot_right_corner_h);
-
-            auto first_triangle = std::make_shared<Triangle>(
-                top_left_corner, bot_left_corner, top_right_corner, mat_, this);
-            auto second_triangle =
-                std::make_shared<Triangle>(top_right_corner, bot_left_corner,
-                                           bot_right_corner, mat_, this);
-
-            mesh_[y][x].first = first_triangle;
-            mesh_[y][x].second = second_triangle;
-        }
-    }
+    height_pyramid_ = HeightPyramid(*heightmap_);
 }
 
 void Terrain::translate(const Vector3 &v)
@@ -76,6 +48,32 @@ void Terrain::translate(const Vector3 &v)
     oceanic_plan_->translate(v);
 }
 
+void Terrain::compute_horizon_map(const Vector3 &light_dir)
+{
+    horizon_map_ = std::make_shared<HorizonMap>(heightmap_, xy_scale_,
+                                                height_scale_, light_dir);
+}
+
+// Points outside the heightmap footprint are left to a shadow ray
+bool Terrain::precomputed_shadow(const Point3 &p, const Vector3 &light_dir,
+                                 bool &shadowed) const
+{
+    if (!horizon_map_ || !horizon_map_->matches(light_dir))
+        return false;
+
+    Point3 local_p = p - translation_;
+    double x = local_p.x_ / xy_scale_;
+    double y = local_p.z_ / xy_scale_;
+    if (x < 0 || x > width_ - 1 || y < 0 || y > height_ - 1)
+        return false;
+
+    HitRecord plan_hit_record;
+    shadowed = (oceanic_plan_
+                    && oceanic_plan_->hit(Ray(p, light_dir), plan_hit_record))
+        || horizon_map_->is_shadowed(y, x, local_p.y_);
+    return true;
+}
+
 LocalTexture Terrain::get_texture_at(const Point3 &p) const
 {
     Point3 local_p = p - translation_;
@@ -93,42 +91,122 @@ Vector3 Terrain::get_normal_at(const Point3 &p) const
     return mat_->get_normal_at(local_p);
 }
 
-bool Terrain::hit(const Ray &ray, HitRecord &hit_record) const
+// World space bounds of a pyramid node, translation is applied at query time
+// because the terrain can be moved after its mesh is built
+AABB Terrain::get_block_bounds(int level, int y, int x) const
 {
-    // std ::cout << ray.origin_ << std::endl;
-    HitRecord closest_hit_record;
-    closest_hit_record.t = utils::infinity;
-    bool hit_anything = false;
+    int y0, y1, x0, x1;
+    height_pyramid_.cell_range(level, y, x, y0, y1, x0, x1);
+
+    Point3 min = translation_
+        + Point3(xy_scale_ * x0,
+                 height_scale_ * height_pyramid_.min_at(level, y, x),
+                 xy_scale_ * y0);
+    Point3 max = translation_
+        + Point3(xy_scale_ * x1,
+                 height_scale_ * height_pyramid_.max_at(level, y, x),
+                 xy_scale_ * y1);
+
+    return AABB(min, max).pad(utils::kEpsilon);
+}
 
-    for (int y = 0; y < height_ - 1; y++)
+// Walk the pyramid top-down, children are visited front to back so that
+// blocks behind the closest hit found so far are skipped
+void Terrain::hit_block(const Ray &ray, int level, int y, int x,
+                        HitRecord &closest_hit_record, bool &hit_anything) const
+{
+    // Nodes of 2x2 cells hold 8 triangles, tested at once
+    if (level <= 1)
     {
-        for (int x = 0; x < width_ - 1; x++)
+        int y0, y1, x0, x1;
+        height_pyramid_.cell_range(level, y, x, y0, y1, x0, x1);
+
+        TriangleBatch batch;
+        for (int cell_y = y0; cell_y < y1; cell_y++)
         {
-            auto triangle = mesh_[y][x].first;
-            HitRecord triangle_hit_record;
-            bool has_hit = triangle->hit(ray, triangle_hit_record);
-            if (has_hit && triangle_hit_record.t < closest_hit_record.t)
+            for (int cell_x = x0; cell_x < x1; cell_x++)
             {
-                closest_hit_record = triangle_hit_record;
-                hit_anything = true;
+                add_cell_triangles(cell_y, cell_x, batch);
             }
+        }
+
+        double t, u, v;
+        if (batch.hit(ray, closest_hit_record.t, t, u, v) >= 0)
+        {
+            closest_hit_record.t = t;
+            closest_hit_record.p = ray.at(t);
+            closest_hit_record.obj = this;
+            closest_hit_record.u = u;
+            closest_hit_record.v = v;
+            hit_anything = true;
+        }
+        return;
+    }
+
+    const HeightPyramid::Level &below = height_pyramid_.levels_[level - 1];
 
-            triangle = mesh_[y][x].second;
-            has_hit = triangle->hit(ray, triangle_hit_record);
-            if (has_hit && triangle_hit_record.t < closest_hit_record.t)
+    std::array<std::pair<double, std::array<int, 2>>, 4> children;
+    int children_count = 0;
+
+    for (int dy = 0; dy < 2; dy++)
+    {
+        for (int dx = 0; dx < 2; dx++)
+        {
+            int child_y = 2 * y + dy;
+            int child_x = 2 * x + dx;
+            if (child_y >= below.height_ || child_x >= below.width_)
+                continue;
+
+            Interval ray_t(0, closest_hit_record.t);
+            if (get_block_bounds(level - 1, child_y, child_x).hit(ray, ray_t))
             {
-                closest_hit_record = triangle_hit_record;
-                hit_anything = true;
+                children[children_count++] = { ray_t.min_,
+                                               { child_y, child_x } };
             }
         }
     }
 
-    HitRecord oceanic_plan_hit_record;
-    if (oceanic_plan_->hit(ray, oceanic_plan_hit_record)
-        && oceanic_plan_hit_record.t < closest_hit_record.t)
+    std::sort(children.begin(), children.begin() + children_count,
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    for (int i = 0; i < children_count; i++)
     {
-        closest_hit_record = oceanic_plan_hit_record;
-        hit_anything = true;
+        if (children[i].first > closest_hit_record.t)
+            break;
+        hit_block(ray, level - 1, children[i].second[0],
+                  children[i].second[1], closest_hit_record, hit_anything);
+    }
+}
+
+void Terrain::add_cell_triangles(int y, int x, TriangleBatch &batch) const
+{
+    Point3 top_left_corner = translation_
+        + make_terrain_point_at(y, x, heightmap_->at(y, x));
+    Point3 top_right_corner = translation_
+        + make_terrain_point_at(y, x + 1, heightmap_->at(y, x + 1));
+    Point3 bot_left_corner = translation_
+        + make_terrain_point_at(y + 1, x, heightmap_->at(y + 1, x));
+    Point3 bot_right_corner = translation_
+        + make_terrain_point_at(y + 1, x + 1, heightmap_->at(y + 1, x + 1));
+
+    batch.add(top_left_corner, bot_left_corner, top_right_corner);
+    batch.add(top_right_corner, bot_left_corner, bot_right_corner);
+}
+
+bool Terrain::hit(const Ray &ray, HitRecord &hit_record) const
+{
+    HitRecord closest_hit_record;
+    closest_hit_record.t = utils::infinity;
+    bool hit_anything = false;
+
+    if (!height_pyramid_.empty())
+    {
+        int top_level = height_pyramid_.top_level();
+        Interval ray_t(0, utils::infinity);
+        if (get_block_bounds(top_level, 0, 0).hit(ray, ray_t))
+        {
+            hit_block(ray, top_level, 0, 0, closest_hit_record, hit_anything);
+        }
     }
 
     if (!hit_anything)
@@ -140,6 +218,16 @@ bool Terrain::hit(const Ray &ray, HitRecord &hit_record) const
     return true;
 }
 
+// The oceanic plan is not included, the box stays finite
+AABB Terrain::bounding_box() const
+{
+    if (height_pyramid_.empty())
+    {
+        return AABB();
+    }
+    return get_block_bounds(height_pyramid_.top_level(), 0, 0);
+}
+
 shared_ptr<Terrain> Terrain::create_terrain(shared_ptr<Heightmap> heightmap,
                                             float xy_scale, float height_scale,
                                             shared_ptr<TextureMaterial> mat,
@@ -3,20 +3,18 @@
 #include <tuple>
 #include <vector>
 
+#include "aabb.hh"
+#include "height_pyramid.hh"
 #include "heightmap.hh"
+#include "horizon_map.hh"
 #include "physobj.hh"
 #include "terrain_oceanic_plan.hh"
-#include "triangle.hh"
+#include "triangle_batch.hh"
 #include "utils.hh"
 
 using std::shared_ptr;
-using std::pair;
 using std::vector;
 
-using SquareTriangle = pair<shared_ptr<Triangle>, shared_ptr<Triangle>>;
-using TriangleLine = vector<SquareTriangle>;
-using Triangle2DMesh = vector<TriangleLine>;
-
 class Terrain : public PhysObj
 {
 public:
@@ -25,10 +23,16 @@ public:
     float xy_scale_;
     float height_scale_;
     shared_ptr<Heightmap> heightmap_;
-    Triangle2DMesh mesh_;
+    // The mesh is implicit: each heightmap cell holds the triangles
+    // (top left, bottom left, top right) and (top right, bottom left,
+    // bottom right), built from the heightmap when a ray reaches the cell
+    HeightPyramid height_pyramid_; // min/max heights, built with the mesh
+    // Infinite, so it is not part of the terrain (hit, box): the scene holds
+    // it as an object of its own
     shared_ptr<TerrainOceanicPlan> oceanic_plan_;
+    shared_ptr<HorizonMap> horizon_map_; // self-shadowing for the sun
 
-    Point3 make_terrain_point_at(int y, int x, float height);
+    Point3 make_terrain_point_at(int y, int x, float height) const;
 
     Terrain();
     Terrain(int height, int width, shared_ptr<TextureMaterial> mat);
@@ -39,8 +43,19 @@ public:
 
     bool hit(const Ray &ray, HitRecord &hit_record) const override;
 
+    AABB bounding_box() const override;
+
+    AABB get_block_bounds(int level, int y, int x) const;
+    void hit_block(const Ray &ray, int level, int y, int x,
+                   HitRecord &closest_hit_record, bool &hit_anything) const;
+    void add_cell_triangles(int y, int x, TriangleBatch &batch) const;
+
     void translate(const Vector3 &v) override;
 
+    void compute_horizon_map(const Vector3 &light_dir);
+    bool precomputed_shadow(const Point3 &p, const Vector3 &light_dir,
+                            bool &shadowed) const override;
+
     LocalTexture get_texture_at(const Point3 &p) const override;
     Vector3 get_normal_at(const Point3 &p) const override;
 
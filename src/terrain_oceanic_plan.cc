@@ -31,11 +31,21 @@ bool TerrainOceanicPlan::hit(const Ray &ray, HitRecord &hit_record) const
 
     hit_record.t = t;
     hit_record.p = p;
-    hit_record.n = get_normal_at(p);
-    hit_record.tex = LocalTexture(); // get_texture_at(p);
+    hit_record.obj = this;
     return true;
 }
 
+void TerrainOceanicPlan::fill_shading(HitRecord &hit_record) const
+{
+    hit_record.n = get_normal_at(hit_record.p);
+    hit_record.tex = LocalTexture(); // get_texture_at(p);
+}
+
+AABB TerrainOceanicPlan::bounding_box() const
+{
+    return horizontal_plane_box(height_);
+}
+
 void TerrainOceanicPlan::translate(const Vector3 &v)
 {
     height_ += v.y_;
@@ -12,6 +12,9 @@ public:
     TerrainOceanicPlan(double height, std::shared_ptr<TerrainLayerTexture> mat);
 
     bool hit(const Ray &ray, HitRecord &hit_record) const override;
+    void fill_shading(HitRecord &hit_record) const override;
+
+    AABB bounding_box() const override;
 
     void translate(const Vector3 &v) override;
 
@@ -1,9 +1,23 @@
 #include "terrain_texture.hh"
 
+#include "generation_cache.hh"
 #include "normal_map_generator.hh"
 #include "ppm_parser.hh"
 #include "terrain_texture_map_generator.hh"
 
+// Everything the texture map generator reads from a layer
+static void add_layer(CacheKey &key, const TerrainLayerTexture &layer)
+{
+    key.add(layer.tex_.color_)
+        .add(layer.tex_.kd_)
+        .add(layer.tex_.ks_)
+        .add(layer.tex_.ns_)
+        .add(layer.tex_.emission_)
+        .add(*layer.texture_map_)
+        .add(layer.scale_)
+        .add(static_cast<int>(layer.projection_type_));
+}
+
 TerrainTexture::TerrainTexture(std::shared_ptr<Heightmap> height_map,
                                double sea_level, double strength,
                                double xy_scale,
@@ -14,19 +28,56 @@ TerrainTexture::TerrainTexture(std::shared_ptr<Heightmap> height_map,
     , params_(params)
     , quality_factor_(quality_factor)
 {
-    normal_map_ = std::make_shared<Image2D>(
-        NormalMapGenerator::generateNormalMap(height_map_, strength, xy_scale));
+    // Normal map, texture map and properties map are cached, keyed by the
+    // heightmap and every parameter of their generators
+    GenerationCache &cache = GenerationCache::shared();
+
+    CacheKey normal_key = CacheKey("terrain_normal_map/1")
+                              .add(*height_map_)
+                              .add(strength)
+                              .add(xy_scale);
+    normal_map_ = std::make_shared<Image2D>(cache.image(normal_key, [&] {
+        return NormalMapGenerator::generateNormalMap(height_map_, strength,
+                                                     xy_scale);
+    }));
+
+    CacheKey texture_key = CacheKey("terrain_texture_map/1")
+                               .add(normal_key)
+                               .add(sea_level)
+                               .add(quality_factor)
+                               .add(params_.cliff_threshold_)
+                               .add(params_.beach_height_);
+    add_layer(texture_key, *params_.above_texture_);
+    add_layer(texture_key, *params_.cliff_texture_);
+    add_layer(texture_key, *params_.beach_texture_);
+    for (const auto &[height, layer] : params_.terrain_layers_textures_)
+    {
+        texture_key.add(height);
+        add_layer(texture_key, *layer);
+    }
+    CacheKey properties_key = CacheKey("terrain_properties_map/1").add(texture_key);
+
+    texture_map_ = std::make_shared<Image2D>();
+    texture_properties_map_ = std::make_shared<Image2D>();
+    if (!cache.load(texture_key, *texture_map_)
+        || !cache.load(properties_key, *texture_properties_map_))
+    {
+        // Colors come from 8-bit layer textures, store them as such
+        texture_map_ = std::make_shared<Image2D>(
+            height_map_->width_ * quality_factor,
+            height_map_->height_ * quality_factor, PixelFormat::RGBA_8);
+        texture_properties_map_ = std::make_shared<Image2D>(
+            height_map_->width_, height_map_->height_);
 
-    texture_map_ =
-        std::make_shared<Image2D>(height_map_->width_ * quality_factor,
-                                  height_map_->height_ * quality_factor);
-    texture_properties_map_ =
-        std::make_shared<Image2D>(height_map_->width_, height_map_->height_);
+        TerrainTextureMapGenerator::generateTerrainTextureMap(
+            height_map_, normal_map_, params_, sea_level, texture_map_,
+            texture_properties_map_, quality_factor);
 
-    TerrainTextureMapGenerator::generateTerrainTextureMap(
-        height_map_, normal_map_, params_, sea_level, texture_map_,
-        texture_properties_map_, quality_factor);
+        cache.store(texture_key, *texture_map_);
+        cache.store(properties_key, *texture_properties_map_);
+    }
 
+    // To preview the maps (also when they come from the cache)
     texture_map_->writePPM("../images/texture_map.ppm");
     texture_properties_map_->writePPM("../images/texture_properties_map.ppm");
 }
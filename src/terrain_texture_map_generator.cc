@@ -1,5 +1,7 @@
 #include "terrain_texture_map_generator.hh"
 
+#include <span>
+
 void TerrainTextureMapGenerator::generateTerrainTextureMap(
     std::shared_ptr<Heightmap> height_map, std::shared_ptr<Image2D> normal_map,
     const TerrainTextureParameters &params, double sea_level,
@@ -8,11 +10,13 @@ void TerrainTextureMapGenerator::generateTerrainTextureMap(
 {
     for (int i = 0; i < texture_map->height_; i++)
     {
+        std::span<const float> heights = height_map->row(i / quality_factor);
+
         for (int j = 0; j < texture_map->width_; j++)
         {
             int small_i = i / quality_factor;
             int small_j = j / quality_factor;
-            double height = height_map->at(small_i, small_j);
+            double height = heights[small_j];
             Vector3 n = normal_map->getNormal(small_i, small_j, true);
 
             LocalTexture pixel_texture = params.getTerrainTexture(
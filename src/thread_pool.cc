@@ -1,50 +1,36 @@
 #include "thread_pool.hh"
 
+#include <algorithm>
+
+// Worker running on the current thread, so that tasks enqueued from a task
+// go to the deque of the worker running it
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
 ThreadPool::ThreadPool(size_t num_threads)
 {
-    // Creating worker threads
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+
     for (size_t i = 0; i < num_threads; ++i)
     {
-        threads_.emplace_back([this] {
-            while (true)
-            {
-                function<void()> task;
-                // The reason for putting the below code
-                // here is to unlock the queue before
-                // executing the task so that other
-                // threads can perform enqueue tasks
-                {
-                    // Locking the queue so that data
-                    // can be shared safely
-                    unique_lock<mutex> lock(queue_mutex_);
-
-                    // Waiting until there is a task to
-                    // execute or the pool is stopped
-                    cv_.wait(lock, [this] { return !tasks_.empty() || stop_; });
-
-                    // exit the thread in case the pool
-                    // is stopped and there are no tasks
-                    if (stop_ && tasks_.empty())
-                    {
-                        return;
-                    }
-
-                    // Get the next task from the queue
-                    task = move(tasks_.front());
-                    tasks_.pop();
-                }
+        queues_.push_back(make_unique<WorkerQueue>());
+    }
 
-                task();
-            }
-        });
+    // Creating worker threads
+    for (size_t i = 0; i < num_threads; ++i)
+    {
+        threads_.emplace_back([this, i] { workerLoop(i); });
     }
 }
 
 ThreadPool::~ThreadPool()
 {
     {
-        // Lock the queue to update the stop flag safely
-        unique_lock<mutex> lock(queue_mutex_);
+        // Lock the state to update the stop flag safely
+        unique_lock<mutex> lock(state_mutex_);
         stop_ = true;
     }
 
@@ -59,17 +45,316 @@ ThreadPool::~ThreadPool()
     }
 }
 
+void ThreadPool::workerLoop(size_t index)
+{
+    current_pool = this;
+    current_worker = index;
+
+    while (true)
+    {
+        function<void()> task;
+
+        if (!popTask(index, task))
+        {
+            unique_lock<mutex> lock(state_mutex_);
+
+            // Waiting until there is a task to
+            // execute or the pool is stopped
+            cv_.wait(lock, [this] { return queued_ > 0 || stop_; });
+
+            // exit the thread in case the pool
+            // is stopped and there are no tasks
+            if (stop_ && queued_ == 0)
+            {
+                return;
+            }
+            continue;
+        }
+
+        runTask(task);
+    }
+}
+
+void ThreadPool::runTask(function<void()> &task)
+{
+    {
+        unique_lock<mutex> lock(state_mutex_);
+        queued_--;
+    }
+
+    task();
+
+    {
+        unique_lock<mutex> lock(state_mutex_);
+        activity_++;
+        activity_cv_.notify_all();
+
+        pending_--;
+        if (pending_ == 0)
+        {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popTask(size_t index, function<void()> &task)
+{
+    {
+        WorkerQueue &own = *queues_[index];
+        unique_lock<mutex> lock(own.mutex_);
+        if (!own.tasks_.empty())
+        {
+            task = move(own.tasks_.back());
+            own.tasks_.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues_.size(); ++i)
+    {
+        WorkerQueue &victim = *queues_[(index + i) % queues_.size()];
+        unique_lock<mutex> lock(victim.mutex_);
+        if (!victim.tasks_.empty())
+        {
+            task = move(victim.tasks_.front());
+            victim.tasks_.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void ThreadPool::enqueue(function<void()> task)
 {
+    size_t index;
+    {
+        unique_lock<mutex> lock(state_mutex_);
+        queued_++;
+        pending_++;
+        activity_++;
+
+        if (current_pool == this)
+        {
+            index = current_worker;
+        }
+        else
+        {
+            index = next_queue_;
+            next_queue_ = (next_queue_ + 1) % queues_.size();
+        }
+    }
+
     {
-        unique_lock<std::mutex> lock(queue_mutex_);
-        tasks_.emplace(move(task));
+        WorkerQueue &queue = *queues_[index];
+        unique_lock<mutex> lock(queue.mutex_);
+        queue.tasks_.emplace_back(move(task));
     }
     cv_.notify_one();
+    activity_cv_.notify_all();
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::tryRunTask()
+{
+    // Outside of the pool, steal starting from the first worker
+    size_t index = current_pool == this ? current_worker : 0;
+
+    function<void()> task;
+    if (!popTask(index, task))
+    {
+        return false;
+    }
+
+    runTask(task);
+    return true;
+}
+
+void ThreadPool::parallel_for(int begin, int end, int grain,
+                              const function<void(int, int)> &fn)
+{
+    grain = max(grain, 1);
+
+    TaskGroup group(*this);
+    for (int chunk_begin = begin; chunk_begin < end; chunk_begin += grain)
+    {
+        int chunk_end = min(end, chunk_begin + grain);
+        group.run([&fn, chunk_begin, chunk_end] { fn(chunk_begin, chunk_end); });
+    }
+    group.wait();
+}
+
+void ThreadPool::wait()
+{
+    unique_lock<mutex> lock(state_mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
 }
 
 bool ThreadPool::isQueueEmpty()
 {
-    unique_lock<std::mutex> lock(queue_mutex_);
-    return tasks_.empty();
+    unique_lock<mutex> lock(state_mutex_);
+    return queued_ == 0;
+}
+
+uint64_t ThreadPool::activity()
+{
+    unique_lock<mutex> lock(state_mutex_);
+    return activity_;
+}
+
+void ThreadPool::waitForActivity(uint64_t seen)
+{
+    unique_lock<mutex> lock(state_mutex_);
+    activity_cv_.wait(lock, [this, seen] { return activity_ != seen; });
+}
+
+size_t ThreadPool::size() const
+{
+    return threads_.size();
+}
+
+
+TaskGroup::TaskGroup(ThreadPool &pool)
+    : pool_(pool)
+{}
+
+TaskGroup::~TaskGroup()
+{
+    try
+    {
+        wait();
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+    }
+    catch (...)
+    {
+        cerr << "Error: Unknown exception in a task" << endl;
+    }
+}
+
+TaskGroup::TaskHandle TaskGroup::run(function<void()> fn,
+                                     const vector<TaskHandle> &after)
+{
+    auto task = make_shared<Task>();
+    task->fn_ = move(fn);
+
+    {
+        unique_lock<mutex> lock(mutex_);
+        unfinished_++;
+
+        for (auto const &dependency : after)
+        {
+            if (!dependency->done_)
+            {
+                dependency->successors_.push_back(task);
+                task->waiting_on_++;
+            }
+        }
+
+        if (task->waiting_on_ > 0)
+        {
+            // Launched by the last dependency to finish
+            return task;
+        }
+    }
+
+    launch(task);
+    return task;
+}
+
+void TaskGroup::launch(const TaskHandle &task)
+{
+    pool_.enqueue([this, task] {
+        bool failed;
+        {
+            unique_lock<mutex> lock(mutex_);
+            failed = exception_ != nullptr;
+        }
+
+        // The task is finished even if it throws, so that wait() returns
+        if (!failed)
+        {
+            try
+            {
+                task->fn_();
+            }
+            catch (...)
+            {
+                unique_lock<mutex> lock(mutex_);
+                if (!exception_)
+                {
+                    exception_ = current_exception();
+                }
+            }
+        }
+        finish(task);
+    });
+}
+
+void TaskGroup::finish(const TaskHandle &task)
+{
+    vector<TaskHandle> ready;
+
+    {
+        unique_lock<mutex> lock(mutex_);
+        task->done_ = true;
+        task->fn_ = nullptr;
+
+        for (auto const &successor : task->successors_)
+        {
+            if (--successor->waiting_on_ == 0)
+            {
+                ready.push_back(successor);
+            }
+        }
+        task->successors_.clear();
+
+        // No successor can be ready once every task has finished, so the
+        // group is not touched anymore after this (the waiting thread is
+        // woken up when the pool task running this returns)
+        unfinished_--;
+    }
+
+    for (auto const &successor : ready)
+    {
+        launch(successor);
+    }
+}
+
+void TaskGroup::wait()
+{
+    while (true)
+    {
+        // (read first, so that no task enqueued or finished after the check
+        // below is missed)
+        uint64_t activity = pool_.activity();
+
+        {
+            unique_lock<mutex> lock(mutex_);
+            if (unfinished_ == 0)
+            {
+                if (exception_)
+                {
+                    exception_ptr exception = exception_;
+                    exception_ = nullptr;
+                    rethrow_exception(exception);
+                }
+                return;
+            }
+        }
+
+        if (!pool_.tryRunTask())
+        {
+            // The remaining tasks are running on other threads, and may still
+            // enqueue new ones to help with
+            pool_.waitForActivity(activity);
+        }
+    }
 }
\ No newline at end of file
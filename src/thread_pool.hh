@@ -1,14 +1,21 @@
 #pragma once
 
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <type_traits>
+#include <vector>
 using namespace std;
 
-// Class that represents a simple thread pool
+// Class that represents a work-stealing thread pool: each worker owns a
+// deque of tasks, and steals from the other workers when its own is empty
 class ThreadPool
 {
 public:
@@ -19,26 +26,154 @@ public:
     // Destructor to stop the thread pool
     ~ThreadPool();
 
+    // Pool shared by the renderer, the scene construction and the map
+    // generators, with one worker per hardware thread
+    static ThreadPool &shared();
+
     // Enqueue task for execution by the thread pool
     void enqueue(function<void()> task);
 
+    // Enqueue a task and get its result (or exception) through a future
+    // Waiting on the future from a task of this pool can deadlock, use a
+    // TaskGroup there instead
+    template <typename F>
+    auto submit(F &&fn) -> future<invoke_result_t<F>>;
+
+    // Call fn(chunk_begin, chunk_end) over [begin, end) split in chunks of
+    // grain indices, the calling thread helps until every chunk is done
+    void parallel_for(int begin, int end, int grain,
+                      const function<void(int, int)> &fn);
+
+    // Run one queued task on the calling thread if there is any, so that
+    // threads waiting for tasks help instead of blocking
+    bool tryRunTask();
+
+    // Block until every enqueued task has finished (must not be called from
+    // a task of this pool)
+    void wait();
+
     bool isQueueEmpty();
 
+    // Number of tasks enqueued or finished so far
+    uint64_t activity();
+
+    // Block until a task is enqueued or finishes, if none was since
+    // activity() returned seen
+    void waitForActivity(uint64_t seen);
+
+    size_t size() const;
+
 private:
+    struct WorkerQueue
+    {
+        deque<function<void()>> tasks_;
+        mutex mutex_;
+    };
+
+    void workerLoop(size_t index);
+
+    // Run a popped task and update the counters
+    void runTask(function<void()> &task);
+
+    // Pop from the back of the worker's own deque, otherwise steal from the
+    // front of another one
+    bool popTask(size_t index, function<void()> &task);
+
     // Vector to store worker threads
     vector<thread> threads_;
 
-    // Queue of tasks
-    queue<function<void()>> tasks_;
+    // One deque of tasks per worker
+    vector<unique_ptr<WorkerQueue>> queues_;
 
-    // Mutex to synchronize access to shared data
-    mutex queue_mutex_;
+    // Mutex to synchronize access to the counters below
+    mutex state_mutex_;
 
-    // Condition variable to signal changes in the state of
-    // the tasks queue
+    // Signaled when tasks are enqueued or the pool is stopped
     condition_variable cv_;
 
+    // Signaled when the last pending task finishes
+    condition_variable done_cv_;
+
+    // Signaled when a task is enqueued or finishes
+    condition_variable activity_cv_;
+
+    // Tasks enqueued or finished so far
+    uint64_t activity_ = 0;
+
+    // Tasks waiting in the deques
+    size_t queued_ = 0;
+
+    // Tasks enqueued and not finished yet
+    size_t pending_ = 0;
+
+    // Deque receiving the next task enqueued from outside the pool
+    size_t next_queue_ = 0;
+
     // Flag to indicate whether the thread pool should stop
     // or not
     bool stop_ = false;
+};
+
+
+template <typename F>
+auto ThreadPool::submit(F &&fn) -> future<invoke_result_t<F>>
+{
+    using Result = invoke_result_t<F>;
+
+    // std::function needs a copyable callable
+    auto task = make_shared<packaged_task<Result()>>(forward<F>(fn));
+    future<Result> result = task->get_future();
+    enqueue([task] { (*task)(); });
+    return result;
+}
+
+// Set of tasks on a pool that can be waited on together, a task can be made
+// to wait for other tasks of the same group
+class TaskGroup
+{
+public:
+    struct Task;
+    using TaskHandle = shared_ptr<Task>;
+
+    TaskGroup(ThreadPool &pool = ThreadPool::shared());
+
+    // Waits for the remaining tasks (their exception is only printed)
+    ~TaskGroup();
+
+    // Schedule fn once every task of after has finished
+    TaskHandle run(function<void()> fn, const vector<TaskHandle> &after = {});
+
+    // Block until every task of the group has finished, running queued tasks
+    // of the pool meanwhile (can be called from a task of the pool).
+    // Rethrows the first exception thrown by a task, the tasks not started
+    // yet at that time are skipped
+    void wait();
+
+private:
+    void launch(const TaskHandle &task);
+    void finish(const TaskHandle &task);
+
+    ThreadPool &pool_;
+
+    // Mutex to synchronize access to the group and its tasks
+    mutex mutex_;
+
+    // Tasks scheduled and not finished yet
+    size_t unfinished_ = 0;
+
+    // First exception thrown by a task, until wait() rethrows it
+    exception_ptr exception_;
+};
+
+struct TaskGroup::Task
+{
+    function<void()> fn_;
+
+    // Tasks of after not finished yet
+    size_t waiting_on_ = 0;
+
+    bool done_ = false;
+
+    // Tasks waiting on this one
+    vector<TaskHandle> successors_;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "triangle.hh"
 
+#include <algorithm>
 #include <iostream>
 
 #include "utils.hh"
@@ -54,10 +55,40 @@ Point3 Triangle::v2() const
     return translation_ + v2_;
 }
 
+AABB Triangle::bounding_box() const
+{
+    Point3 a = v0();
+    Point3 b = v1();
+    Point3 c = v2();
+
+    return AABB(Point3(std::min({ a.x_, b.x_, c.x_ }),
+                       std::min({ a.y_, b.y_, c.y_ }),
+                       std::min({ a.z_, b.z_, c.z_ })),
+                Point3(std::max({ a.x_, b.x_, c.x_ }),
+                       std::max({ a.y_, b.y_, c.y_ }),
+                       std::max({ a.z_, b.z_, c.z_ })))
+        .pad(utils::kEpsilon);
+}
+
 bool Triangle::hit(const Ray &ray, HitRecord &hit_record) const
+{
+    if (!intersect(ray, v0(), v1(), v2(), n_, hit_record))
+    {
+        return false;
+    }
+
+    hit_record.obj = this;
+    return true;
+}
+
+// Shared with the implicit terrain mesh, whose triangles only exist as grid
+// coordinates, hence the vertices and normal being passed in
+bool Triangle::intersect(const Ray &ray, const Point3 &v0, const Point3 &v1,
+                         const Point3 &v2, const Vector3 &n,
+                         HitRecord &hit_record)
 {
     // check if the ray and triangle plane are parallel
-    double nDotRayDir = Vector3::dot(n_, ray.direction_);
+    double nDotRayDir = Vector3::dot(n, ray.direction_);
     if (Interval(-utils::kEpsilon, +utils::kEpsilon).surrounds(nDotRayDir))
     {
         // Ray perpendicular to the plane
@@ -69,8 +100,8 @@ bool Triangle::hit(const Ray &ray, HitRecord &hit_record) const
         return false;
     }
 
-    double d = -Vector3::dot(n_, v0());
-    double t = -(Vector3::dot(n_, ray.origin_) + d) / nDotRayDir;
+    double d = -Vector3::dot(n, v0);
+    double t = -(Vector3::dot(n, ray.origin_) + d) / nDotRayDir;
     if (t < 0)
     {
         return false;
@@ -82,30 +113,30 @@ bool Triangle::hit(const Ray &ray, HitRecord &hit_record) const
     Vector3 c;
 
     // Edge 0
-    Vector3 edge0 = v1() - v0();
-    Vector3 vp0 = p - v0();
+    Vector3 edge0 = v1 - v0;
+    Vector3 vp0 = p - v0;
     c = Vector3::cross(edge0, vp0);
-    if (Vector3::dot(n_, c) < 0)
+    if (Vector3::dot(n, c) < 0)
     {
         // p is on the right side of the edge 0
         return false;
     }
 
     // Edge1
-    Vector3 edge1 = v2() - v1();
-    Vector3 vp1 = p - v1();
+    Vector3 edge1 = v2 - v1;
+    Vector3 vp1 = p - v1;
     c = Vector3::cross(edge1, vp1);
-    if (Vector3::dot(n_, c) < 0)
+    if (Vector3::dot(n, c) < 0)
     {
         // p is on the right side of the edge 1
         return false;
     }
 
     // Edge2
-    Vector3 edge2 = v0() - v2();
-    Vector3 vp2 = p - v2();
+    Vector3 edge2 = v0 - v2;
+    Vector3 vp2 = p - v2;
     c = Vector3::cross(edge2, vp2);
-    if (Vector3::dot(n_, c) < 0)
+    if (Vector3::dot(n, c) < 0)
     {
         // p is on the right side of the edge 2
         return false;
@@ -115,18 +146,29 @@ bool Triangle::hit(const Ray &ray, HitRecord &hit_record) const
     // std::cout << "ray direction: " << ray.direction_ << std::endl;
     // std::cout << t << " " << p << std::endl;
 
+    // Barycentric coordinates, from the sub-triangles opposite v1 and v2
+    double area = Vector3::dot(n, Vector3::cross(edge0, v2 - v0));
+    double u = Vector3::dot(n, Vector3::cross(edge2, vp2)) / area;
+    double v = Vector3::dot(n, Vector3::cross(edge0, vp0)) / area;
+
     hit_record.t = t;
     hit_record.p = p;
+    hit_record.u = u;
+    hit_record.v = v;
+
+    return true;
+}
+
+void Triangle::fill_shading(HitRecord &hit_record) const
+{
     if (parent_ != nullptr)
     {
-        hit_record.n = parent_->get_normal_at(p);
-        hit_record.tex = parent_->get_texture_at(p);
+        hit_record.n = parent_->get_normal_at(hit_record.p);
+        hit_record.tex = parent_->get_texture_at(hit_record.p);
     }
     else
     {
         hit_record.n = n_;
-        hit_record.tex = get_texture_at(p);
+        hit_record.tex = get_texture_at(hit_record.p);
     }
-
-    return true;
 }
\ No newline at end of file
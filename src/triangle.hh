@@ -28,4 +28,10 @@ public:
     Point3 v2() const;
 
     bool hit(const Ray &ray, HitRecord &hit_record) const override;
+    static bool intersect(const Ray &ray, const Point3 &v0, const Point3 &v1,
+                          const Point3 &v2, const Vector3 &n,
+                          HitRecord &hit_record);
+    void fill_shading(HitRecord &hit_record) const override;
+
+    AABB bounding_box() const override;
 };
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "triangle_batch.hh"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "utils.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define TRIANGLE_BATCH_X86
+#endif
+
+TriangleBatch::TriangleBatch()
+    : count_(0)
+{}
+
+void TriangleBatch::add(const Point3 &v0, const Point3 &v1, const Point3 &v2)
+{
+    if (count_ == kSize)
+        throw std::length_error("TriangleBatch: Batch is full");
+
+    Vector3 e1 = v1 - v0;
+    Vector3 e2 = v2 - v0;
+
+    v0_x_[count_] = v0.x_;
+    v0_y_[count_] = v0.y_;
+    v0_z_[count_] = v0.z_;
+    e1_x_[count_] = e1.x_;
+    e1_y_[count_] = e1.y_;
+    e1_z_[count_] = e1.z_;
+    e2_x_[count_] = e2.x_;
+    e2_y_[count_] = e2.y_;
+    e2_z_[count_] = e2.z_;
+    // Same threshold as Triangle::hit on the dot product of the unit normal
+    // and the ray direction
+    min_det_[count_] = utils::kEpsilon * Vector3::cross(e1, e2).length();
+    count_++;
+}
+
+using BatchKernel = int (*)(const TriangleBatch &, const Ray &, double,
+                            double &, double &, double &);
+
+/**
+ * @brief Möller-Trumbore test of the ray against triangle i.
+ *
+ * The determinant is minus the dot product of the ray direction and the
+ * unnormalized normal, so a positive one means the front side is hit.
+ */
+static bool hit_one(const TriangleBatch &batch, int i, const Ray &ray,
+                    double t_max, double &t, double &u, double &v)
+{
+    const Vector3 &d = ray.direction_;
+
+    double p_x = d.y_ * batch.e2_z_[i] - d.z_ * batch.e2_y_[i];
+    double p_y = d.z_ * batch.e2_x_[i] - d.x_ * batch.e2_z_[i];
+    double p_z = d.x_ * batch.e2_y_[i] - d.y_ * batch.e2_x_[i];
+    double det = batch.e1_x_[i] * p_x + batch.e1_y_[i] * p_y
+        + batch.e1_z_[i] * p_z;
+    if (!(det > 0) || det < batch.min_det_[i])
+        return false;
+    double inv_det = 1.0 / det;
+
+    double s_x = ray.origin_.x_ - batch.v0_x_[i];
+    double s_y = ray.origin_.y_ - batch.v0_y_[i];
+    double s_z = ray.origin_.z_ - batch.v0_z_[i];
+    double hit_u = (s_x * p_x + s_y * p_y + s_z * p_z) * inv_det;
+    if (hit_u < 0 || hit_u > 1)
+        return false;
+
+    double q_x = s_y * batch.e1_z_[i] - s_z * batch.e1_y_[i];
+    double q_y = s_z * batch.e1_x_[i] - s_x * batch.e1_z_[i];
+    double q_z = s_x * batch.e1_y_[i] - s_y * batch.e1_x_[i];
+    double hit_v = (d.x_ * q_x + d.y_ * q_y + d.z_ * q_z) * inv_det;
+    if (hit_v < 0 || hit_u + hit_v > 1)
+        return false;
+
+    double hit_t = (batch.e2_x_[i] * q_x + batch.e2_y_[i] * q_y
+                    + batch.e2_z_[i] * q_z)
+        * inv_det;
+    if (hit_t < 0 || hit_t > t_max)
+        return false;
+
+    t = hit_t;
+    u = hit_u;
+    v = hit_v;
+    return true;
+}
+
+static int hit_scalar(const TriangleBatch &batch, const Ray &ray,
+                      double t_max, double &t, double &u, double &v)
+{
+    int closest = -1;
+    for (int i = 0; i < batch.count_; i++)
+    {
+        if (hit_one(batch, i, ray, t_max, t, u, v))
+        {
+            closest = i;
+            t_max = t;
+        }
+    }
+    return closest;
+}
+
+#ifdef TRIANGLE_BATCH_X86
+
+// The SIMD kernels perform the same operations in the same order as hit_one
+// (no fused multiply-add), so all kernels agree bit for bit
+
+__attribute__((target("avx2"))) static int
+hit_avx2(const TriangleBatch &batch, const Ray &ray, double t_max, double &t,
+         double &u, double &v)
+{
+    const __m256d d_x = _mm256_set1_pd(ray.direction_.x_);
+    const __m256d d_y = _mm256_set1_pd(ray.direction_.y_);
+    const __m256d d_z = _mm256_set1_pd(ray.direction_.z_);
+    const __m256d o_x = _mm256_set1_pd(ray.origin_.x_);
+    const __m256d o_y = _mm256_set1_pd(ray.origin_.y_);
+    const __m256d o_z = _mm256_set1_pd(ray.origin_.z_);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    int closest = -1;
+    for (int base = 0; base < batch.count_; base += 4)
+    {
+        __m256d e1_x = _mm256_load_pd(batch.e1_x_ + base);
+        __m256d e1_y = _mm256_load_pd(batch.e1_y_ + base);
+        __m256d e1_z = _mm256_load_pd(batch.e1_z_ + base);
+        __m256d e2_x = _mm256_load_pd(batch.e2_x_ + base);
+        __m256d e2_y = _mm256_load_pd(batch.e2_y_ + base);
+        __m256d e2_z = _mm256_load_pd(batch.e2_z_ + base);
+
+        __m256d p_x = _mm256_sub_pd(_mm256_mul_pd(d_y, e2_z),
+                                    _mm256_mul_pd(d_z, e2_y));
+        __m256d p_y = _mm256_sub_pd(_mm256_mul_pd(d_z, e2_x),
+                                    _mm256_mul_pd(d_x, e2_z));
+        __m256d p_z = _mm256_sub_pd(_mm256_mul_pd(d_x, e2_y),
+                                    _mm256_mul_pd(d_y, e2_x));
+        __m256d det = _mm256_add_pd(
+            _mm256_add_pd(_mm256_mul_pd(e1_x, p_x), _mm256_mul_pd(e1_y, p_y)),
+            _mm256_mul_pd(e1_z, p_z));
+        __m256d valid = _mm256_and_pd(
+            _mm256_cmp_pd(det, zero, _CMP_GT_OQ),
+            _mm256_cmp_pd(det, _mm256_load_pd(batch.min_det_ + base),
+                          _CMP_GE_OQ));
+        __m256d inv_det = _mm256_div_pd(one, det);
+
+        __m256d s_x = _mm256_sub_pd(o_x, _mm256_load_pd(batch.v0_x_ + base));
+        __m256d s_y = _mm256_sub_pd(o_y, _mm256_load_pd(batch.v0_y_ + base));
+        __m256d s_z = _mm256_sub_pd(o_z, _mm256_load_pd(batch.v0_z_ + base));
+        __m256d hit_u = _mm256_mul_pd(
+            _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(s_x, p_x), _mm256_mul_pd(s_y, p_y)),
+                _mm256_mul_pd(s_z, p_z)),
+            inv_det);
+        valid = _mm256_and_pd(valid, _mm256_cmp_pd(hit_u, zero, _CMP_GE_OQ));
+        valid = _mm256_and_pd(valid, _mm256_cmp_pd(hit_u, one, _CMP_LE_OQ));
+
+        __m256d q_x = _mm256_sub_pd(_mm256_mul_pd(s_y, e1_z),
+                                    _mm256_mul_pd(s_z, e1_y));
+        __m256d q_y = _mm256_sub_pd(_mm256_mul_pd(s_z, e1_x),
+                                    _mm256_mul_pd(s_x, e1_z));
+        __m256d q_z = _mm256_sub_pd(_mm256_mul_pd(s_x, e1_y),
+                                    _mm256_mul_pd(s_y, e1_x));
+        __m256d hit_v = _mm256_mul_pd(
+            _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(d_x, q_x), _mm256_mul_pd(d_y, q_y)),
+                _mm256_mul_pd(d_z, q_z)),
+            inv_det);
+        valid = _mm256_and_pd(valid, _mm256_cmp_pd(hit_v, zero, _CMP_GE_OQ));
+        valid = _mm256_and_pd(
+            valid,
+            _mm256_cmp_pd(_mm256_add_pd(hit_u, hit_v), one, _CMP_LE_OQ));
+
+        __m256d hit_t = _mm256_mul_pd(
+            _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(e2_x, q_x), _mm256_mul_pd(e2_y, q_y)),
+                _mm256_mul_pd(e2_z, q_z)),
+            inv_det);
+        valid = _mm256_and_pd(valid, _mm256_cmp_pd(hit_t, zero, _CMP_GE_OQ));
+        valid = _mm256_and_pd(
+            valid, _mm256_cmp_pd(hit_t, _mm256_set1_pd(t_max), _CMP_LE_OQ));
+
+        int mask = _mm256_movemask_pd(valid);
+        if (mask == 0)
+            continue;
+
+        alignas(32) double lanes_t[4];
+        alignas(32) double lanes_u[4];
+        alignas(32) double lanes_v[4];
+        _mm256_store_pd(lanes_t, hit_t);
+        _mm256_store_pd(lanes_u, hit_u);
+        _mm256_store_pd(lanes_v, hit_v);
+        for (int lane = 0; lane < 4 && base + lane < batch.count_; lane++)
+        {
+            if ((mask & (1 << lane)) && lanes_t[lane] <= t_max)
+            {
+                closest = base + lane;
+                t_max = lanes_t[lane];
+                t = lanes_t[lane];
+                u = lanes_u[lane];
+                v = lanes_v[lane];
+            }
+        }
+    }
+    return closest;
+}
+
+__attribute__((target("sse4.1"))) static int
+hit_sse4(const TriangleBatch &batch, const Ray &ray, double t_max, double &t,
+         double &u, double &v)
+{
+    const __m128d d_x = _mm_set1_pd(ray.direction_.x_);
+    const __m128d d_y = _mm_set1_pd(ray.direction_.y_);
+    const __m128d d_z = _mm_set1_pd(ray.direction_.z_);
+    const __m128d o_x = _mm_set1_pd(ray.origin_.x_);
+    const __m128d o_y = _mm_set1_pd(ray.origin_.y_);
+    const __m128d o_z = _mm_set1_pd(ray.origin_.z_);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+
+    int closest = -1;
+    for (int base = 0; base < batch.count_; base += 2)
+    {
+        __m128d e1_x = _mm_load_pd(batch.e1_x_ + base);
+        __m128d e1_y = _mm_load_pd(batch.e1_y_ + base);
+        __m128d e1_z = _mm_load_pd(batch.e1_z_ + base);
+        __m128d e2_x = _mm_load_pd(batch.e2_x_ + base);
+        __m128d e2_y = _mm_load_pd(batch.e2_y_ + base);
+        __m128d e2_z = _mm_load_pd(batch.e2_z_ + base);
+
+        __m128d p_x = _mm_sub_pd(_mm_mul_pd(d_y, e2_z), _mm_mul_pd(d_z, e2_y));
+        __m128d p_y = _mm_sub_pd(_mm_mul_pd(d_z, e2_x), _mm_mul_pd(d_x, e2_z));
+        __m128d p_z = _mm_sub_pd(_mm_mul_pd(d_x, e2_y), _mm_mul_pd(d_y, e2_x));
+        __m128d det = _mm_add_pd(
+            _mm_add_pd(_mm_mul_pd(e1_x, p_x), _mm_mul_pd(e1_y, p_y)),
+            _mm_mul_pd(e1_z, p_z));
+        __m128d valid =
+            _mm_and_pd(_mm_cmpgt_pd(det, zero),
+                       _mm_cmpge_pd(det, _mm_load_pd(batch.min_det_ + base)));
+        __m128d inv_det = _mm_div_pd(one, det);
+
+        __m128d s_x = _mm_sub_pd(o_x, _mm_load_pd(batch.v0_x_ + base));
+        __m128d s_y = _mm_sub_pd(o_y, _mm_load_pd(batch.v0_y_ + base));
+        __m128d s_z = _mm_sub_pd(o_z, _mm_load_pd(batch.v0_z_ + base));
+        __m128d hit_u = _mm_mul_pd(
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(s_x, p_x), _mm_mul_pd(s_y, p_y)),
+                       _mm_mul_pd(s_z, p_z)),
+            inv_det);
+        valid = _mm_and_pd(valid, _mm_cmpge_pd(hit_u, zero));
+        valid = _mm_and_pd(valid, _mm_cmple_pd(hit_u, one));
+
+        __m128d q_x = _mm_sub_pd(_mm_mul_pd(s_y, e1_z), _mm_mul_pd(s_z, e1_y));
+        __m128d q_y = _mm_sub_pd(_mm_mul_pd(s_z, e1_x), _mm_mul_pd(s_x, e1_z));
+        __m128d q_z = _mm_sub_pd(_mm_mul_pd(s_x, e1_y), _mm_mul_pd(s_y, e1_x));
+        __m128d hit_v = _mm_mul_pd(
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(d_x, q_x), _mm_mul_pd(d_y, q_y)),
+                       _mm_mul_pd(d_z, q_z)),
+            inv_det);
+        valid = _mm_and_pd(valid, _mm_cmpge_pd(hit_v, zero));
+        valid = _mm_and_pd(valid, _mm_cmple_pd(_mm_add_pd(hit_u, hit_v), one));
+
+        __m128d hit_t = _mm_mul_pd(
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(e2_x, q_x), _mm_mul_pd(e2_y, q_y)),
+                       _mm_mul_pd(e2_z, q_z)),
+            inv_det);
+        valid = _mm_and_pd(valid, _mm_cmpge_pd(hit_t, zero));
+        valid = _mm_and_pd(valid, _mm_cmple_pd(hit_t, _mm_set1_pd(t_max)));
+
+        int mask = _mm_movemask_pd(valid);
+        if (mask == 0)
+            continue;
+
+        alignas(32) double lanes_t[2];
+        alignas(32) double lanes_u[2];
+        alignas(32) double lanes_v[2];
+        _mm_store_pd(lanes_t, hit_t);
+        _mm_store_pd(lanes_u, hit_u);
+        _mm_store_pd(lanes_v, hit_v);
+        for (int lane = 0; lane < 2 && base + lane < batch.count_; lane++)
+        {
+            if ((mask & (1 << lane)) && lanes_t[lane] <= t_max)
+            {
+                closest = base + lane;
+                t_max = lanes_t[lane];
+                t = lanes_t[lane];
+                u = lanes_u[lane];
+                v = lanes_v[lane];
+            }
+        }
+    }
+    return closest;
+}
+
+#endif
+
+static BatchKernel select_kernel()
+{
+#ifdef TRIANGLE_BATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return hit_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return hit_sse4;
+#endif
+    return hit_scalar;
+}
+
+static const BatchKernel kernel_ = select_kernel();
+
+int TriangleBatch::hit(const Ray &ray, double t_max, double &t, double &u,
+                       double &v) const
+{
+    return kernel_(*this, ray, t_max, t, u, v);
+}
+
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ray.hh"
+#include "vector3.hh"
+
+// A small group of one sided triangles stored as structure of arrays, tested
+// against a single ray at once
+// The kernel is picked at runtime: AVX2 (4 triangles per instruction),
+// SSE4.1 (2 triangles per instruction) or a scalar fallback
+class TriangleBatch
+{
+public:
+    static constexpr int kSize = 8;
+
+    // First vertex and the two edges leaving it, per triangle
+    alignas(32) double v0_x_[kSize] = {};
+    alignas(32) double v0_y_[kSize] = {};
+    alignas(32) double v0_z_[kSize] = {};
+    alignas(32) double e1_x_[kSize] = {};
+    alignas(32) double e1_y_[kSize] = {};
+    alignas(32) double e1_z_[kSize] = {};
+    alignas(32) double e2_x_[kSize] = {};
+    alignas(32) double e2_y_[kSize] = {};
+    alignas(32) double e2_z_[kSize] = {};
+    // Minimum determinant to not be seen edge on, scaled by the edge lengths
+    // Unused lanes stay zeroed, which no kernel counts as a hit
+    alignas(32) double min_det_[kSize] = {};
+    int count_;
+
+    TriangleBatch();
+
+    // Front side as for Triangle: cross(v1 - v0, v2 - v0) points towards it
+    // Throws std::length_error if the batch already holds kSize triangles
+    void add(const Point3 &v0, const Point3 &v1, const Point3 &v2);
+
+    // Closest hit with t in [0, t_max], u and v are the barycentric weights of
+    // the second and third vertices
+    // Returns the index of the triangle hit, or -1
+    int hit(const Ray &ray, double t_max, double &t, double &u,
+            double &v) const;
+};
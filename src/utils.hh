@@ -1,8 +1,12 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdlib>
 #include <cmath>
+#include <istream>
 #include <limits>
+#include <new>
+#include <ostream>
 
 namespace utils
 {
@@ -50,4 +54,46 @@ namespace utils
     inline float euclidianDistance(float y1, float x1, float y2, float x2) {
         return std::sqrt(std::pow(y1 - y2, 2) + std::pow(x1 - x2, 2));
     }
+
+    // Raw (machine byte order) binary I/O of trivially copyable values
+    template <typename T>
+    inline void writeBinary(std::ostream& os, const T& value) {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    inline T readBinary(std::istream& is) {
+        T value{};
+        is.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    // Allocator of std::vector storage aligned on Alignment bytes (aligned SIMD loads and stores)
+    template <typename T, std::size_t Alignment>
+    struct AlignedAllocator
+    {
+        using value_type = T;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() = default;
+
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        }
+
+        void deallocate(T* p, std::size_t) {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    };
 } // namespace utils
\ No newline at end of file
@@ -2,9 +2,10 @@
 
 #include <cmath>
 #include <iostream>
-#include <list>
-#include <tuple>
+#include <limits>
+#include <vector>
 
+#include "thread_pool.hh"
 #include "utils.hh"
 
 Image2D WaveMapGenerator::generateShoreWaveMap(
@@ -59,82 +60,128 @@ Heightmap WaveMapGenerator::generateAboveWaterMap(
     return above_water_map;
 }
 
-double dist(double x1, double y1, double x2, double y2)
+/**
+ * @brief Squared distance transform of a 1D sampled function.
+ *
+ * Lower envelope of the parabolas (q - p)^2 + f(p) (Felzenszwalb and
+ * Huttenlocher), in O(n). Infinite samples are left out of the envelope.
+ *
+ * @param f Input samples, read with the given stride
+ * @param d Output samples, written with the given stride
+ * @param n Number of samples
+ * @param stride Distance between two samples in f and d
+ * @param v Scratch buffer of n parabola locations
+ * @param z Scratch buffer of n + 1 envelope boundaries
+ */
+static void distance_transform_1d(const double *f, double *d, int n,
+                                  int stride, std::vector<int> &v,
+                                  std::vector<double> &z)
 {
-    return std::sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    int k = -1;
+    for (int q = 0; q < n; q++)
+    {
+        double f_q = f[q * stride];
+        if (f_q == infinity)
+            continue;
+
+        double s = -infinity;
+        while (k >= 0)
+        {
+            int p = v[k];
+            s = ((f_q + static_cast<double>(q) * q)
+                 - (f[p * stride] + static_cast<double>(p) * p))
+                / (2.0 * q - 2.0 * p);
+            if (s > z[k])
+                break;
+            k--;
+        }
+
+        k++;
+        v[k] = q;
+        z[k] = k == 0 ? -infinity : s;
+        z[k + 1] = infinity;
+    }
+
+    if (k < 0)
+    {
+        for (int q = 0; q < n; q++)
+            d[q * stride] = infinity;
+        return;
+    }
+
+    int j = 0;
+    for (int q = 0; q < n; q++)
+    {
+        while (z[j + 1] < q)
+            j++;
+        double offset = q - v[j];
+        d[q * stride] = offset * offset + f[v[j] * stride];
+    }
 }
 
+/**
+ * @brief Distance of every water pixel to the closest shore pixel.
+ *
+ * Shore pixels are land pixels with a water 4-neighbour. The closest land
+ * pixel of a water pixel is always a shore pixel, so this is the exact
+ * Euclidean distance transform of the land pixels. It is computed
+ * separably, over the columns then the rows, each pass running in parallel.
+ * Without any land, distances are the maximum double, as before.
+ */
 Heightmap
 WaveMapGenerator::generateDistToShoreMap(const Heightmap &above_water_map)
 {
     int rows = above_water_map.height_;
     int cols = above_water_map.width_;
-    Heightmap distances(rows, cols);
+    Heightmap distances(cols, rows);
 
-    std::list<std::pair<int, int>> above_pixels;
-    std::list<std::pair<int, int>> other_pixels;
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    // Squared distances, row-major
+    std::vector<double> land(static_cast<size_t>(rows) * cols);
+    std::vector<double> squared(land.size());
 
     for (int i = 0; i < rows; i++)
     {
         for (int j = 0; j < cols; j++)
         {
-            double above = above_water_map.at(i, j);
-            if (above > 0.0)
-            {
-                distances.set(i, j, 0.0);
-
-                std::list<std::pair<int, int>> neighbors;
-                if (i > 0)
-                {
-                    neighbors.push_back({ i - 1, j });
-                }
-                if (i < rows - 1)
-                {
-                    neighbors.push_back({ i + 1, j });
-                }
-                if (j > 0)
-                {
-                    neighbors.push_back({ i, j - 1 });
-                }
-                if (j < cols - 1)
-                {
-                    neighbors.push_back({ i, j + 1 });
-                }
-
-                bool all_neighbors_are_above = true;
-                for (auto &n : neighbors)
-                {
-                    if (above_water_map.at(n.first, n.second) == 0.0)
-                    {
-                        all_neighbors_are_above = false;
-                        break;
-                    }
-                }
-                if (!all_neighbors_are_above)
-                {
-                    above_pixels.push_back({ i, j });
-                }
-            }
-            else
-            {
-                other_pixels.push_back({ i, j });
-            }
+            land[static_cast<size_t>(i) * cols + j] =
+                above_water_map.at(i, j) > 0.0 ? 0.0 : infinity;
         }
     }
 
-    for (auto &p : other_pixels)
-    {
-        double min_dist = std::numeric_limits<double>::max();
-        for (auto &a : above_pixels)
+    ThreadPool &pool = ThreadPool::shared();
+
+    pool.parallel_for(0, cols, 16, [&](int col_begin, int col_end) {
+        std::vector<int> v(rows);
+        std::vector<double> z(rows + 1);
+        for (int j = col_begin; j < col_end; j++)
+        {
+            distance_transform_1d(land.data() + j, squared.data() + j, rows,
+                                  cols, v, z);
+        }
+    });
+
+    pool.parallel_for(0, rows, 16, [&](int row_begin, int row_end) {
+        std::vector<int> v(cols);
+        std::vector<double> z(cols + 1);
+        std::vector<double> row(cols);
+        for (int i = row_begin; i < row_end; i++)
         {
-            double d = dist(p.first, p.second, a.first, a.second);
-            if (d < min_dist)
+            double *line = squared.data() + static_cast<size_t>(i) * cols;
+            distance_transform_1d(line, row.data(), cols, 1, v, z);
+
+            for (int j = 0; j < cols; j++)
             {
-                min_dist = d;
+                distances.set(i, j,
+                              row[j] == infinity
+                                  ? std::numeric_limits<double>::max()
+                                  : std::sqrt(row[j]));
             }
         }
-        distances.set(p.first, p.second, min_dist);
-    }
+    });
 
     return distances;
 }